@@ -0,0 +1,129 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "delete_spec_benchmark.h"
+#include "editor/commands/sdf_command_group.h"
+#include "editor/commands/undo_layer_state_delegate.h"
+#include <benchmark/benchmark.h>
+#include <spdlog/fmt/fmt.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/usd/sdf/attributeSpec.h>
+#include <pxr/usd/sdf/changeBlock.h>
+#include <pxr/usd/sdf/data.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/sdf/schema.h>
+#include <memory>
+#include <utility>
+
+namespace vox::benchmark {
+namespace {
+// attributes of each prim, each one holding a small array
+constexpr int kAttributesPerPrim = 4;
+
+const SdfPath &root_path() {
+    static const SdfPath path("/root");
+    return path;
+}
+
+// /root with range(0) child prims, every prim with a few array attributes
+SdfLayerRefPtr make_layer(const ::benchmark::State &state) {
+    SdfLayerRefPtr layer = SdfLayer::CreateAnonymous();
+    SdfChangeBlock block;
+    auto root = SdfPrimSpec::New(layer, root_path().GetName(), SdfSpecifierDef, "Xform");
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        auto prim = SdfPrimSpec::New(root, fmt::format("prim_{}", i), SdfSpecifierDef, "Mesh");
+        for (int j = 0; j < kAttributesPerPrim; ++j) {
+            auto attribute = SdfAttributeSpec::New(prim, fmt::format("attr_{}", j), SdfValueTypeNames->FloatArray);
+            attribute->SetDefaultValue(VtValue(VtFloatArray(16, float(i))));
+        }
+    }
+    return layer;
+}
+
+void remove_root(const SdfLayerRefPtr &layer) {
+    layer->RemoveRootPrim(layer->GetPrimAtPath(root_path()));
+}
+
+// the copy UndoRedoDeleteSpec makes of the deleted subtree, without the state delegate around it
+SdfDataRefPtr copy_subtree(const SdfLayerRefPtr &layer) {
+    SdfDataRefPtr data = TfCreateRefPtr(new SdfData());
+    SdfChangeBlock block;
+    layer->Traverse(root_path(), [&](const SdfPath &path) {
+        data->CreateSpec(path, layer->GetSpecType(path));
+        for (const auto &field : layer->ListFields(path)) {
+            data->Set(path, field, layer->GetField(path, field));
+        }
+    });
+    return data;
+}
+
+void set_counters(::benchmark::State &state) {
+    state.counters["specs"] = ::benchmark::Counter(double(state.range(0) * (kAttributesPerPrim + 1) + 1),
+                                                   ::benchmark::Counter::kIsIterationInvariantRate);
+}
+
+void delete_unrecorded(::benchmark::State &state) {
+    for ([[maybe_unused]] auto _ : state) {
+        state.PauseTiming();
+        SdfLayerRefPtr layer = make_layer(state);
+        state.ResumeTiming();
+        remove_root(layer);
+        state.PauseTiming();
+        layer.Reset();
+        state.ResumeTiming();
+    }
+    set_counters(state);
+}
+
+void delete_data_copy(::benchmark::State &state) {
+    for ([[maybe_unused]] auto _ : state) {
+        state.PauseTiming();
+        SdfLayerRefPtr layer = make_layer(state);
+        state.ResumeTiming();
+        SdfDataRefPtr captured = copy_subtree(layer);
+        remove_root(layer);
+        state.PauseTiming();
+        captured.Reset();
+        layer.Reset();
+        state.ResumeTiming();
+    }
+    set_counters(state);
+}
+
+void delete_recorded(::benchmark::State &state) {
+    size_t footprint = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        state.PauseTiming();
+        SdfLayerRefPtr layer = make_layer(state);
+        auto group = std::make_unique<SdfCommandGroup>();
+        layer->SetStateDelegate(UndoRedoLayerStateDelegate::create(*group));
+        state.ResumeTiming();
+        remove_root(layer);
+        state.PauseTiming();
+        footprint = group->footprint();
+        layer.Reset();
+        group.reset();
+        state.ResumeTiming();
+    }
+    state.counters["undo_bytes"] = double(footprint);
+    set_counters(state);
+}
+}// namespace
+
+void register_delete_spec_benchmarks() {
+    for (auto [name, func] : {std::pair{"unrecorded", &delete_unrecorded},
+                              std::pair{"data_copy", &delete_data_copy},
+                              std::pair{"recorded", &delete_recorded}}) {
+        ::benchmark::RegisterBenchmark(fmt::format("delete_spec/{}", name).c_str(), func)
+            ->ArgNames({"prims"})
+            ->Args({10000})
+            ->Args({100000})
+            ->Unit(::benchmark::kMillisecond)
+            ->UseRealTime();
+    }
+}
+
+}// namespace vox::benchmark
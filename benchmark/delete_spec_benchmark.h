@@ -0,0 +1,14 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+namespace vox::benchmark {
+/// Delete a large prim hierarchy from a layer: without recording, after copying the subtree into an SdfData, and
+/// recorded for undo by the editor state delegate.
+void register_delete_spec_benchmarks();
+
+}// namespace vox::benchmark
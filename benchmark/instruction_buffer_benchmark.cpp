@@ -0,0 +1,176 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "instruction_buffer_benchmark.h"
+#include "editor/commands/sdf_command_group.h"
+#include <benchmark/benchmark.h>
+#include <spdlog/fmt/fmt.h>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vox::benchmark {
+namespace {
+// command group storage before the instruction arena, kept as the reference
+class LegacyCommandGroup {
+public:
+    template<typename InstructionT, typename... ArgsT>
+    void emplace_instruction(ArgsT &&...args) {
+        _instructions.push_back(std::make_unique<Storage<InstructionT>>(InstructionT(_table, std::forward<ArgsT>(args)...)));
+    }
+
+    void do_it() {
+        SdfChangeBlock block;
+        for (auto &cmd : _instructions) {
+            cmd->do_it(_table);
+        }
+    }
+
+    void undo_it() {
+        SdfChangeBlock block;
+        for (auto cmd = _instructions.rbegin(); cmd != _instructions.rend(); ++cmd) {
+            (*cmd)->undo_it(_table);
+        }
+    }
+
+private:
+    struct Interface {
+        virtual ~Interface() = default;
+        virtual void do_it(const InternTable &table) = 0;
+        virtual void undo_it(const InternTable &table) = 0;
+    };
+
+    template<typename InstructionT>
+    struct Storage : Interface {
+        explicit Storage(InstructionT &&inst) : _data(std::move(inst)) {}
+
+        void do_it(const InternTable &table) override { _data.do_it(table); }
+        void undo_it(const InternTable &table) override { _data.undo_it(table); }
+
+        InstructionT _data;
+    };
+
+    std::vector<std::unique_ptr<Interface>> _instructions;
+    InternTable _table;
+};
+
+// half spec creations, half field edits on the created specs
+template<typename GroupT>
+void record(GroupT &group, const SdfLayerHandle &layer, const std::vector<SdfPath> &paths) {
+    for (const auto &path : paths) {
+        group.template emplace_instruction<UndoRedoCreateSpec>(layer, path, SdfSpecTypePrim, false);
+        group.template emplace_instruction<UndoRedoSetField>(layer, path, SdfFieldKeys->Comment, VtValue(path.GetString()),
+                                                             VtValue());
+    }
+}
+
+struct Scene {
+    // without a layer the instructions return immediately, which measures the storage and dispatch alone
+    SdfLayerRefPtr layer;
+    std::vector<SdfPath> paths;
+};
+
+Scene make_scene(const ::benchmark::State &state) {
+    Scene scene;
+    if (state.range(1) != 0) {
+        scene.layer = SdfLayer::CreateAnonymous();
+    }
+    const auto num_paths = size_t(state.range(0)) / 2;
+    scene.paths.reserve(num_paths);
+    for (size_t i = 0; i < num_paths; ++i) {
+        scene.paths.emplace_back(fmt::format("/prim_{}", i));
+    }
+    return scene;
+}
+
+void set_counters(::benchmark::State &state) {
+    state.counters["instructions"] = ::benchmark::Counter(double(state.range(0)),
+                                                          ::benchmark::Counter::kIsIterationInvariantRate);
+}
+
+template<typename GroupT>
+void record_instructions(::benchmark::State &state) {
+    const auto scene = make_scene(state);
+    for ([[maybe_unused]] auto _ : state) {
+        // the group is destroyed inside the timed loop, releasing the instructions is part of the cost
+        GroupT group;
+        record(group, scene.layer, scene.paths);
+        ::benchmark::DoNotOptimize(&group);
+    }
+    set_counters(state);
+}
+
+template<typename GroupT>
+void undo_redo_instructions(::benchmark::State &state) {
+    const auto scene = make_scene(state);
+    GroupT group;
+    record(group, scene.layer, scene.paths);
+    if constexpr (std::is_same_v<GroupT, SdfCommandGroup>) {
+        // memory kept in the undo stack once the recording is done, the table included
+        group.end_recording();
+        state.counters["bytes_per_instruction"] = double(group.footprint()) / double(state.range(0));
+    }
+    group.do_it();
+    for ([[maybe_unused]] auto _ : state) {
+        group.undo_it();
+        group.do_it();
+    }
+    set_counters(state);
+}
+
+// An edit session dragging for range(0) frames: two fields of a spec and a time sample of the same spec are set
+// every frame, interleaved. The merged group must keep one instruction per value however long the drag is.
+void record_interleaved_drag(::benchmark::State &state) {
+    const auto frames = size_t(state.range(0));
+    const SdfLayerHandle layer;
+    const SdfPath path("/prim.attr");
+    size_t count = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        SdfCommandGroup group;
+        group.set_merge_edits(true);
+        for (size_t frame = 0; frame < frames; ++frame) {
+            const VtValue value(double(frame));
+            group.emplace_instruction<UndoRedoSetField>(layer, path, SdfFieldKeys->Default, value, VtValue());
+            group.emplace_instruction<UndoRedoSetField>(layer, path, SdfFieldKeys->Comment, value, VtValue());
+            group.emplace_instruction<UndoRedoSetTimeSample>(layer, path, 1.0, value);
+        }
+        count = group.instruction_count();
+        ::benchmark::DoNotOptimize(&group);
+    }
+    if (count != 3) {
+        state.SkipWithError(fmt::format("the drag kept {} instructions instead of 3", count).c_str());
+    }
+    state.counters["instructions"] = double(count);
+    state.counters["edits"] = ::benchmark::Counter(double(3 * frames), ::benchmark::Counter::kIsIterationInvariantRate);
+}
+
+template<typename GroupT>
+void register_group(std::string_view name) {
+    for (auto [suffix, func] : {std::pair{"record", &record_instructions<GroupT>},
+                                std::pair{"undo_redo", &undo_redo_instructions<GroupT>}}) {
+        ::benchmark::RegisterBenchmark(fmt::format("instructions/{}/{}", name, suffix).c_str(), func)
+            ->ArgNames({"count", "layer"})
+            ->Args({1000000, 0})
+            ->Args({1000000, 1})
+            ->Unit(::benchmark::kMillisecond)
+            ->UseRealTime();
+    }
+}
+}// namespace
+
+void register_instruction_buffer_benchmarks() {
+    register_group<LegacyCommandGroup>("legacy");
+    register_group<SdfCommandGroup>("arena");
+    ::benchmark::RegisterBenchmark("instructions/session/interleaved_drag", &record_interleaved_drag)
+        ->ArgNames({"frames"})
+        ->Args({10000})
+        ->Unit(::benchmark::kMillisecond)
+        ->UseRealTime();
+}
+
+}// namespace vox::benchmark
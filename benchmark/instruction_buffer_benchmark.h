@@ -0,0 +1,15 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+namespace vox::benchmark {
+/// Compare the arena-backed SdfCommandGroup with the previous heap-allocated, virtually dispatched
+/// instruction wrapper: recording, then undo and redo of the same instructions. Also records an interleaved
+/// edit session drag, which fails if its edits are not merged into one instruction per value.
+void register_instruction_buffer_benchmarks();
+
+}// namespace vox::benchmark
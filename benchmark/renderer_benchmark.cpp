@@ -0,0 +1,190 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "renderer_benchmark.h"
+#include "segment_xform_benchmark.h"
+#include "usd_primitive.h"
+#include <benchmark/benchmark.h>
+#include <pxr/usd/usd/stage.h>
+#include <spdlog/fmt/fmt.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+namespace vox::benchmark {
+namespace {
+enum class Scene {
+    Spheres,
+    Meshes,
+    Lines,
+};
+
+struct SceneData {
+    std::vector<pxr::TfToken> names;
+    // mesh grid or rope vertices
+    pxr::VtVec3fArray points;
+    pxr::VtIntArray indices;
+    size_t num_frames{0};
+};
+
+// the peak is process wide, so a benchmark reports the maximum of every benchmark run before it
+double peak_rss_mb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return double(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+    return double(usage.ru_maxrss) / 1024.0;
+#endif
+}
+
+std::vector<pxr::TfToken> make_names(const char *prefix, size_t count) {
+    std::vector<pxr::TfToken> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        names.emplace_back(fmt::format("{}_{}", prefix, i));
+    }
+    return names;
+}
+
+// square grid of about num_points points in the xz plane, as a triangle list
+void make_grid(size_t num_points, pxr::VtVec3fArray &points, pxr::VtIntArray &indices) {
+    const auto side = std::max<size_t>(2, size_t(std::sqrt(double(num_points))));
+    points.resize(side * side);
+    for (size_t z = 0; z < side; ++z) {
+        for (size_t x = 0; x < side; ++x) {
+            points[z * side + x] = pxr::GfVec3f(float(x), 0.f, float(z));
+        }
+    }
+
+    indices.reserve((side - 1) * (side - 1) * 6);
+    for (size_t z = 0; z + 1 < side; ++z) {
+        for (size_t x = 0; x + 1 < side; ++x) {
+            const auto i = int(z * side + x);
+            const auto s = int(side);
+            for (int index : {i, i + s, i + 1, i + 1, i + s, i + s + 1}) {
+                indices.push_back(index);
+            }
+        }
+    }
+}
+
+SceneData make_scene(Scene scene, const ::benchmark::State &state) {
+    SceneData data;
+    switch (scene) {
+        case Scene::Spheres:
+            data.names = make_names("sphere", size_t(state.range(0)));
+            data.num_frames = size_t(state.range(1));
+            break;
+        case Scene::Meshes:
+            data.names = make_names("mesh", size_t(state.range(0)));
+            make_grid(size_t(state.range(1)), data.points, data.indices);
+            data.num_frames = size_t(state.range(2));
+            break;
+        case Scene::Lines:
+            data.names = make_names("rope", 1);
+            make_rope(size_t(state.range(0)), data.points, data.indices);
+            data.num_frames = size_t(state.range(1));
+            break;
+    }
+    return data;
+}
+
+void render_frame(UsdRenderer &renderer, Scene scene, const SceneData &data, float time) {
+    switch (scene) {
+        case Scene::Spheres:
+            for (size_t i = 0; i < data.names.size(); ++i) {
+                const pxr::GfVec3f pos(float(i), std::sin(time + float(i)), 0.f);
+                renderer.render_sphere(data.names[i], pos, pxr::GfQuatf(1.f), 0.5f);
+            }
+            break;
+        case Scene::Meshes: {
+            // a new buffer every frame, as handed over by a simulation
+            pxr::VtVec3fArray points = data.points;
+            for (auto &point : points) {
+                point[1] = std::sin(time + point[0]);
+            }
+            for (const auto &name : data.names) {
+                renderer.render_mesh(name, points, data.indices);
+            }
+            break;
+        }
+        case Scene::Lines: {
+            pxr::VtVec3fArray vertices = data.points;
+            for (auto &vertex : vertices) {
+                vertex[2] += time;
+            }
+            renderer.render_line_list(data.names.front(), vertices, data.indices, pxr::GfVec3f(1.f), 0.01f);
+            break;
+        }
+    }
+}
+
+void renderer_scene(::benchmark::State &state, Scene scene, bool save) {
+    const auto data = make_scene(scene, state);
+    const auto path = (std::filesystem::temp_directory_path() / "usd_renderer_benchmark.usdc").string();
+
+    WriteStats stats;
+    size_t file_bytes = 0;
+    for ([[maybe_unused]] auto _ : state) {
+        auto stage = save ? pxr::UsdStage::CreateNew(path) : pxr::UsdStage::CreateInMemory();
+        UsdRenderer renderer(stage);
+        for (size_t frame = 0; frame < data.num_frames; ++frame) {
+            const float time = float(frame) / 60.f;
+            renderer.begin_frame(time);
+            render_frame(renderer, scene, data, time);
+            renderer.end_frame();
+        }
+        if (save) {
+            renderer.save();
+            file_bytes = std::filesystem::file_size(path);
+        }
+        stats = renderer.write_stats();
+    }
+
+    state.counters["frames"] = ::benchmark::Counter(double(data.num_frames), ::benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["values"] = ::benchmark::Counter(double(stats.values), ::benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["bytes"] = ::benchmark::Counter(double(stats.bytes), ::benchmark::Counter::kDefaults,
+                                                   ::benchmark::Counter::kIs1024);
+    if (save) {
+        state.counters["file_bytes"] = ::benchmark::Counter(double(file_bytes), ::benchmark::Counter::kDefaults,
+                                                            ::benchmark::Counter::kIs1024);
+    }
+    state.counters["peak_rss_mb"] = peak_rss_mb();
+}
+}// namespace
+
+void register_renderer_benchmarks() {
+    for (const bool save : {false, true}) {
+        const char *output = save ? "usdc" : "memory";
+        ::benchmark::RegisterBenchmark(fmt::format("renderer/spheres/{}", output).c_str(), renderer_scene, Scene::Spheres, save)
+            ->ArgNames({"spheres", "frames"})
+            ->Args({100, 100})
+            ->Args({1000, 100})
+            ->Args({10000, 20})
+            ->Unit(::benchmark::kMillisecond)
+            ->UseRealTime();
+
+        ::benchmark::RegisterBenchmark(fmt::format("renderer/meshes/{}", output).c_str(), renderer_scene, Scene::Meshes, save)
+            ->ArgNames({"meshes", "points", "frames"})
+            ->Args({10, 10000, 50})
+            ->Args({100, 1000, 50})
+            ->Args({10, 100000, 10})
+            ->Unit(::benchmark::kMillisecond)
+            ->UseRealTime();
+
+        ::benchmark::RegisterBenchmark(fmt::format("renderer/lines/{}", output).c_str(), renderer_scene, Scene::Lines, save)
+            ->ArgNames({"segments", "frames"})
+            ->Args({10000, 50})
+            ->Args({100000, 50})
+            ->Args({1000000, 10})
+            ->Unit(::benchmark::kMillisecond)
+            ->UseRealTime();
+    }
+}
+
+}// namespace vox::benchmark
@@ -0,0 +1,14 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+namespace vox::benchmark {
+/// Drive UsdRenderer with animated scenes (spheres, deforming meshes, line lists) over a number of frames,
+/// recording to an in-memory stage or saving to usdc.
+void register_renderer_benchmarks();
+
+}// namespace vox::benchmark
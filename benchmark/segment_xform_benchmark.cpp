@@ -0,0 +1,86 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "segment_xform_benchmark.h"
+#include "usd_segment_xform.h"
+#include <benchmark/benchmark.h>
+#include <pxr/base/gf/rotation.h>
+#include <spdlog/fmt/fmt.h>
+#include <cmath>
+#include <string_view>
+
+namespace vox::benchmark {
+namespace {
+// per-segment path used by render_line_list before the batched kernel, kept as the reference
+void reference_segment_xforms(const pxr::VtVec3fArray &vertices, const pxr::VtIntArray &indices, SegmentXforms &out) {
+    out.positions = {};
+    out.orientations = {};
+    out.scales = {};
+    auto num_lines = int(indices.size() / 2);
+    for (int i = 0; i < num_lines; ++i) {
+        auto pos0 = vertices[indices[i * 2 + 0]];
+        auto pos1 = vertices[indices[i * 2 + 1]];
+
+        auto mid = (pos0 + pos1) * 0.5;
+        auto height = (pos1 - pos0).GetLength();
+        auto dir = (pos1 - pos0) / height;
+        pxr::GfRotation rot{pxr::GfVec3d(0.0, 0.0, 1.0), pxr::GfVec3d(dir)};
+
+        out.positions.push_back(mid);
+        out.orientations.push_back(pxr::GfQuath(rot.GetQuat()));
+        out.scales.push_back(pxr::GfVec3f(1.0, 1.0, height));
+    }
+}
+
+void segment_xforms(::benchmark::State &state, bool batched) {
+    const auto num_segments = size_t(state.range(0));
+    pxr::VtVec3fArray vertices;
+    pxr::VtIntArray indices;
+    make_rope(num_segments, vertices, indices);
+
+    SegmentXforms xforms;
+    for ([[maybe_unused]] auto _ : state) {
+        if (batched) {
+            compute_segment_xforms({vertices.cdata(), vertices.size()}, {indices.cdata(), indices.size()}, xforms);
+        } else {
+            reference_segment_xforms(vertices, indices, xforms);
+        }
+        ::benchmark::DoNotOptimize(xforms.positions.cdata());
+    }
+
+    state.counters["segments"] =
+        ::benchmark::Counter(double(num_segments),
+                             ::benchmark::Counter::kIsIterationInvariant |
+                                 ::benchmark::Counter::kIsRate,
+                             ::benchmark::Counter::kIs1000);
+}
+}// namespace
+
+void make_rope(size_t num_segments, pxr::VtVec3fArray &vertices, pxr::VtIntArray &indices) {
+    vertices.resize(num_segments + 1);
+    for (size_t i = 0; i <= num_segments; ++i) {
+        const float t = float(i) * 0.01f;
+        vertices[i] = pxr::GfVec3f(std::cos(t), std::sin(t), t * 0.1f);
+    }
+    indices.resize(num_segments * 2);
+    for (size_t i = 0; i < num_segments; ++i) {
+        indices[i * 2 + 0] = int(i);
+        indices[i * 2 + 1] = int(i + 1);
+    }
+}
+
+void register_segment_xform_benchmarks() {
+    for (const char *path : {"reference", "batched"}) {
+        const bool batched = std::string_view(path) == "batched";
+        ::benchmark::RegisterBenchmark(fmt::format("segment_xform/{}", path).c_str(), segment_xforms, batched)
+            ->RangeMultiplier(10)
+            ->Range(1000, 1000000)
+            ->Unit(::benchmark::kMicrosecond)
+            ->UseRealTime();
+    }
+}
+
+}// namespace vox::benchmark
@@ -0,0 +1,19 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <pxr/base/vt/types.h>
+
+namespace vox::benchmark {
+/// A rope of num_segments segments wound around a helix, so that every segment has a different orientation.
+void make_rope(size_t num_segments, pxr::VtVec3fArray &vertices, pxr::VtIntArray &indices);
+
+/// Compare the batched segment kernel used by render_line_list / render_line_strip
+/// with the previous per-segment GfRotation path.
+void register_segment_xform_benchmarks();
+
+}// namespace vox::benchmark
@@ -0,0 +1,22 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include <benchmark/benchmark.h>
+#include "delete_spec_benchmark.h"
+#include "instruction_buffer_benchmark.h"
+#include "renderer_benchmark.h"
+#include "segment_xform_benchmark.h"
+
+int main(int argc, char **argv) {
+    ::benchmark::Initialize(&argc, argv);
+
+    vox::benchmark::register_segment_xform_benchmarks();
+    vox::benchmark::register_renderer_benchmarks();
+    vox::benchmark::register_instruction_buffer_benchmarks();
+    vox::benchmark::register_delete_spec_benchmarks();
+
+    ::benchmark::RunSpecifiedBenchmarks();
+}
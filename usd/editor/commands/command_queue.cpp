@@ -0,0 +1,65 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "command_queue.h"
+#include "commands_impl.h"
+
+namespace vox {
+CommandQueue::CommandQueue() : _head(&_stub), _tail(&_stub) {}
+
+CommandQueue::~CommandQueue() {
+    while (Command *command = pop()) {
+        delete command;
+    }
+}
+
+void CommandQueue::push(Command *command) {
+    auto *node = new Node;
+    node->command = command;
+    _push_node(node);
+}
+
+void CommandQueue::_push_node(Node *node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node *previous = _head.exchange(node, std::memory_order_acq_rel);
+    // between the exchange and this store the list is cut, pop sees it as empty
+    previous->next.store(node, std::memory_order_release);
+}
+
+Command *CommandQueue::pop() {
+    Node *tail = _tail;
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+        if (!next) {
+            return nullptr;
+        }
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (!next) {
+        if (tail != _head.load(std::memory_order_acquire)) {
+            // a producer is linking a node after tail
+            return nullptr;
+        }
+        // tail is the last node, the stub goes behind it so that tail can be released
+        _push_node(&_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return nullptr;
+        }
+    }
+    _tail = next;
+    Command *command = tail->command;
+    delete tail;
+    return command;
+}
+
+bool CommandQueue::empty() const {
+    return _tail == &_stub && !_stub.next.load(std::memory_order_acquire);
+}
+
+}// namespace vox
@@ -0,0 +1,51 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <atomic>
+
+namespace vox {
+struct Command;
+
+/// Unbounded multi producer single consumer queue of commands (Vyukov's intrusive queue).
+/// Any thread can push without locking, only the thread executing the commands pops.
+/// The queue owns the commands it holds until they are popped.
+class CommandQueue {
+public:
+    CommandQueue();
+    ~CommandQueue();
+
+    CommandQueue(const CommandQueue &) = delete;
+    CommandQueue &operator=(const CommandQueue &) = delete;
+
+    /// Thread safe
+    void push(Command *command);
+
+    /// Consumer only. Returns nullptr when the queue is empty, or when the next command is still being pushed by
+    /// another thread, it is then returned by a later pop.
+    Command *pop();
+
+    /// Consumer only
+    [[nodiscard]] bool empty() const;
+
+private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        Command *command = nullptr;
+    };
+
+    void _push_node(Node *node);
+
+    /// Producers insert at the head
+    std::atomic<Node *> _head;
+    /// The consumer removes at the tail
+    Node *_tail;
+    /// Placeholder node keeping the list non-empty
+    Node _stub;
+};
+
+}// namespace vox
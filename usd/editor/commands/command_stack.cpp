@@ -6,42 +6,446 @@
 
 #include "command_stack.h"
 
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <utility>
 #include "sdf_command_group_recorder.h"
+#include "sdf_command_serializer.h"
 
 namespace vox {
-CommandStack *CommandStack::instance = nullptr;
+/// Executes a list of commands in order and holds the undo entries they made, so that they are undone and
+/// redone as one.
+struct CompositeCommand : public Command {
+    CompositeCommand() = default;
+    ~CompositeCommand() override = default;
 
-CommandStack &CommandStack::get_instance() {
-    if (!instance) {
-        instance = new CommandStack();
+    bool do_it() override;
+    bool undo_it() override;
+    [[nodiscard]] size_t footprint() const override;
+    [[nodiscard]] size_t instruction_count() const override;
+
+    /// The commands to execute, empty once they ran
+    std::vector<std::unique_ptr<Command>> _pending;
+    /// The undo entries made by the commands
+    std::vector<std::unique_ptr<Command>> _done;
+};
+
+bool CompositeCommand::do_it() {
+    if (_pending.empty()) {
+        // Redo
+        for (auto &command : _done) {
+            command->do_it();
+        }
+        return true;
+    }
+    CommandStack &commandStack = CommandStack::get_instance();
+    CompositeCommand *parentGroup = commandStack.activeGroup;
+    commandStack.activeGroup = this;
+    for (auto &command : _pending) {
+        if (command->do_it()) {
+            _done.push_back(std::move(command));
+        }
     }
+    commandStack.activeGroup = parentGroup;
+    _pending.clear();
+    return !_done.empty();
+}
+
+bool CompositeCommand::undo_it() {
+    for (auto command = _done.rbegin(); command != _done.rend(); ++command) {
+        (*command)->undo_it();
+    }
+    return false;
+}
+
+size_t CompositeCommand::footprint() const {
+    size_t bytes = sizeof(*this) + _done.capacity() * sizeof(std::unique_ptr<Command>);
+    for (const auto &command : _done) {
+        bytes += command->footprint();
+    }
+    return bytes;
+}
+
+size_t CompositeCommand::instruction_count() const {
+    size_t count = 0;
+    for (const auto &command : _done) {
+        count += command->instruction_count();
+    }
+    return count;
+}
+
+namespace {
+/// The instruction groups recorded by a command, false if some of its edits were not recorded
+bool _collect_groups(const Command *command, std::vector<const SdfCommandGroup *> &groups) {
+    if (const auto *layerCommand = dynamic_cast<const SdfLayerCommand *>(command)) {
+        groups.push_back(&layerCommand->_undoCommands);
+        return true;
+    }
+    if (const auto *composite = dynamic_cast<const CompositeCommand *>(command)) {
+        return std::all_of(composite->_done.begin(), composite->_done.end(),
+                           [&groups](const auto &child) { return _collect_groups(child.get(), groups); });
+    }
+    return false;
+}
+
+/// The instruction groups replayed by the undo, or the redo, of a command in the order they run. False if part
+/// of it is not a replay of instructions.
+bool _collect_replay_groups(Command *command, bool undo, std::vector<SdfCommandGroup *> &groups) {
+    if (SdfCommandGroup *group = command->replay_group(undo)) {
+        groups.push_back(group);
+        return true;
+    }
+    if (auto *composite = dynamic_cast<CompositeCommand *>(command)) {
+        auto collect = [undo, &groups](const auto &child) { return _collect_replay_groups(child.get(), undo, groups); };
+        // the children are undone in reverse order
+        return undo ? std::all_of(composite->_done.rbegin(), composite->_done.rend(), collect)
+                    : std::all_of(composite->_done.begin(), composite->_done.end(), collect);
+    }
+    return false;
+}
+
+// Below this count the replay runs at once
+constexpr size_t kIncrementalReplayMinInstructions = 100000;
+// The clock is checked between chunks of instructions
+constexpr size_t kReplayChunkInstructions = 4096;
+// Time given to the replay in each frame
+constexpr auto kReplayFrameBudget = std::chrono::milliseconds(8);
+
+/// The group opened by begin_command_group on this thread
+thread_local std::unique_ptr<CompositeCommand> openGroup;
+thread_local int openGroupDepth = 0;
+}// namespace
+
+CommandStack &CommandStack::get_instance() {
+    // thread safe initialization, commands can be pushed from any thread
+    static auto *instance = new CommandStack();
     return *instance;
 }
 
 CommandStack::CommandStack() = default;
 
-CommandStack::~CommandStack() {
-    delete instance;
+CommandStack::~CommandStack() = default;
+
+void CommandStack::push_command(Command *command) {
+    if (openGroup) {
+        openGroup->_pending.emplace_back(command);
+    } else {
+        pendingCommands.push(command);
+    }
 }
 
 void CommandStack::execute_commands() {
-    if (lastCmd) {
-        if (lastCmd->do_it()) {
-            _push_command(lastCmd);
+    if (replay) {
+        _continue_replay();
+    }
+    // the owner of a session not updated for a whole frame stopped without ending it, it would hold the queue
+    if (editSession && editSession->idleFrames++ > 0) {
+        cancel_edit_session();
+    }
+    // the commands would edit a stage half undone, they wait for the end of the replay,
+    // and they would be undone with the edit session if it is cancelled
+    while (!replay && !editSession) {
+        Command *command = pendingCommands.pop();
+        if (!command) {
+            break;
+        }
+        if (command->do_it()) {
+            _push_command(command);
         } else {
-            delete lastCmd;
+            delete command;
+        }
+    }
+}
+
+bool CommandStack::_begin_replay(Command *command, bool undo) {
+    std::vector<SdfCommandGroup *> groups;
+    if (!_collect_replay_groups(command, undo, groups)) {
+        return false;
+    }
+    size_t total = 0;
+    for (const auto *group : groups) {
+        total += group->instruction_count();
+    }
+    if (total < kIncrementalReplayMinInstructions) {
+        return false;
+    }
+    replay = std::make_unique<Replay>();
+    replay->groups = std::move(groups);
+    replay->undo = undo;
+    replay->total = total;
+    // the first slice runs in this frame
+    _continue_replay();
+    return true;
+}
+
+void CommandStack::_continue_replay() {
+    const auto deadline = std::chrono::steady_clock::now() + kReplayFrameBudget;
+    while (replay->group < replay->groups.size()) {
+        SdfCommandGroup *group = replay->groups[replay->group];
+        const size_t count = std::min(kReplayChunkInstructions, group->instruction_count() - replay->offset);
+        group->replay(replay->undo, replay->offset, count);
+        replay->offset += count;
+        replay->done += count;
+        if (replay->offset == group->instruction_count()) {
+            replay->group++;
+            replay->offset = 0;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return;
         }
-        lastCmd = nullptr;// Reset the command
     }
+    // closing the change block sends the notices of the whole replay
+    replay.reset();
+}
+
+float CommandStack::get_replay_progress() const {
+    return replay && replay->total ? float(replay->done) / float(replay->total) : 1.f;
+}
+
+uint64_t CommandStack::begin_edit_session(const SdfLayerRefPtr &layer) {
+    commit_edit_session();
+    if (!layer || replay) {
+        return 0;
+    }
+    editSession = std::make_unique<EditSession>();
+    editSession->id = ++lastEditSessionId;
+    editSession->layer = layer;
+    editSession->command = std::make_unique<SdfUndoRedoCommand>();
+    editSession->command->_undoCommands.set_merge_edits(true);
+    editSession->delegate = UndoRedoLayerStateDelegate::create(editSession->command->_undoCommands);
+    return editSession->id;
+}
+
+uint64_t CommandStack::begin_edit_session(const UsdStageRefPtr &stage) {
+    return begin_edit_session(stage ? stage->GetEditTarget().GetLayer() : SdfLayerRefPtr());
+}
+
+void CommandStack::update_edit_session(const std::function<void()> &edit) {
+    if (!editSession) {
+        return;
+    }
+    editSession->idleFrames = 0;
+    const SdfLayerRefPtr &layer = editSession->layer;
+    SdfLayerStateDelegateBaseRefPtr previousDelegate = layer->GetStateDelegate();
+    layer->SetStateDelegate(editSession->delegate);
+    {
+        SdfChangeBlock block;
+        edit();
+    }
+    layer->SetStateDelegate(previousDelegate);
+}
+
+void CommandStack::commit_edit_session() {
+    if (!editSession) {
+        return;
+    }
+    std::unique_ptr<EditSession> session = std::move(editSession);
+    SdfCommandGroup &group = session->command->_undoCommands;
+    if (group.is_empty()) {
+        return;
+    }
+    group.set_merge_edits(false);
+    group.end_recording();
+    _push_command(session->command.release());
+}
+
+void CommandStack::cancel_edit_session() {
+    if (!editSession) {
+        return;
+    }
+    std::unique_ptr<EditSession> session = std::move(editSession);
+    // the layer has its own delegate back, the undo is not recorded
+    session->command->_undoCommands.undo_it();
+}
+
+void ScopedEditSession::begin(const UsdStageRefPtr &stage) {
+    commit();
+    _id = CommandStack::get_instance().begin_edit_session(stage);
+}
+
+void ScopedEditSession::update(const std::function<void()> &edit) {
+    if (_is_open()) {
+        CommandStack::get_instance().update_edit_session(edit);
+    }
+}
+
+void ScopedEditSession::commit() {
+    if (_is_open()) {
+        CommandStack::get_instance().commit_edit_session();
+    }
+    _id = 0;
+}
+
+void ScopedEditSession::cancel() {
+    if (_is_open()) {
+        CommandStack::get_instance().cancel_edit_session();
+    }
+    _id = 0;
+}
+
+bool ScopedEditSession::_is_open() const {
+    return _id != 0 && CommandStack::get_instance().get_edit_session_id() == _id;
 }
 
 void CommandStack::_push_command(Command *cmd) {
-    if (undoStackPos != undoStack.size()) {
-        undoStack.resize(undoStackPos);
+    if (activeGroup) {
+        activeGroup->_done.emplace_back(cmd);
+        return;
+    }
+    if (sessionJournal) {
+        std::vector<const SdfCommandGroup *> groups;
+        if (_collect_groups(cmd, groups)) {
+            sessionJournal->write_push(groups);
+        } else {
+            sessionJournal->write_lost();
+        }
     }
-    undoStack.emplace_back(cmd);
+    _truncate_redo();
+    const size_t footprint = cmd->footprint();
+    undoStack.push_back({std::unique_ptr<Command>(cmd), footprint});
+    undoStackBytes += footprint;
     undoStackPos++;
+    _evict_over_budget();
+}
+
+void CommandStack::_truncate_redo() {
+    while (undoStack.size() > size_t(undoStackPos)) {
+        undoStackBytes -= undoStack.back().footprint;
+        undoStack.pop_back();
+    }
+}
+
+void CommandStack::_evict_over_budget() {
+    if (undoJournal) {
+        _journal_over_budget();
+    }
+    // only commands that are done can go, evicting a redo entry would break the redo order
+    while (undoStackPos > 1 && (undoStack.size() > undoBudgetSteps || undoStackBytes > undoBudgetBytes)) {
+        undoStackBytes -= undoStack.front().footprint;
+        undoStack.pop_front();
+        undoStackPos--;
+    }
+}
+
+void CommandStack::set_undo_budget(size_t maxBytes, size_t maxSteps) {
+    undoBudgetBytes = maxBytes;
+    undoBudgetSteps = std::max<size_t>(maxSteps, 1);
+    _evict_over_budget();
+}
+
+void CommandStack::_journal_over_budget() {
+    while (undoStackBytes > undoBudgetBytes) {
+        // the entries the farthest from the position are the last ones undo or redo will need,
+        // the next command to undo and the next to redo always stay in memory
+        UndoEntry *farthest = nullptr;
+        size_t farthestDistance = 0;
+        const auto position = size_t(undoStackPos);
+        for (size_t i = 0; i < undoStack.size(); ++i) {
+            auto &entry = undoStack[i];
+            const size_t distance = i < position ? position - 1 - i : i - position;
+            if (entry.command && entry.journalable && distance > farthestDistance) {
+                farthest = &entry;
+                farthestDistance = distance;
+            }
+        }
+        if (!farthest) {
+            break;
+        }
+        _journal_entry(*farthest);
+    }
+}
+
+bool CommandStack::_journal_entry(UndoEntry &entry) {
+    if (!entry.journalRecord) {
+        // only a command whose undo is a replay of its instructions can be undone without the command, the same
+        // commands are replayed over several frames
+        const SdfCommandGroup *group = entry.command->replay_group(true);
+        std::vector<char> data;
+        if (group && serialize_command_group(*group, entry.journalLayers, data)) {
+            entry.journalRecord = undoJournal->append(data);
+        }
+        if (!entry.journalRecord) {
+            entry.journalable = false;
+            entry.journalLayers.clear();
+            return false;
+        }
+    }
+    undoStackBytes -= entry.footprint;
+    entry.command.reset();
+    entry.footprint = sizeof(UndoJournal::Record) + entry.journalLayers.size() * sizeof(SdfLayerRefPtr);
+    undoStackBytes += entry.footprint;
+    return true;
+}
+
+Command *CommandStack::_resident_command(size_t index) {
+    auto &entry = undoStack[index];
+    if (!entry.command && undoJournal && entry.journalRecord) {
+        // undo and redo of a layer command are the replay of its instructions
+        auto command = std::make_unique<SdfUndoRedoCommand>();
+        std::vector<char> data;
+        if (!undoJournal->read(*entry.journalRecord, data) ||
+            !deserialize_command_group(data, entry.journalLayers, command->_undoCommands)) {
+            std::cerr << "Unable to read the undo entry " << index << " from the journal, undo and redo stop there"
+                      << std::endl;
+            return nullptr;
+        }
+        undoStackBytes -= entry.footprint;
+        entry.footprint = command->footprint();
+        undoStackBytes += entry.footprint;
+        entry.command = std::move(command);
+    }
+    return entry.command.get();
+}
+
+void CommandStack::set_undo_journal(bool enabled) {
+    if (enabled == bool(undoJournal)) {
+        return;
+    }
+    if (enabled) {
+        undoJournal = std::make_unique<UndoJournal>();
+        if (!undoJournal->is_open()) {
+            undoJournal.reset();
+            return;
+        }
+    } else {
+        // everything comes back in memory, the budget then evicts what doesn't fit
+        for (size_t i = 0; i < undoStack.size(); ++i) {
+            _resident_command(i);
+            undoStack[i].journalRecord.reset();
+            undoStack[i].journalLayers.clear();
+        }
+        undoJournal.reset();
+    }
+    _evict_over_budget();
+}
+
+void CommandStack::set_session_journal(bool enabled) {
+    if (enabled == bool(sessionJournal)) {
+        return;
+    }
+    if (enabled) {
+        sessionJournal = std::make_unique<SessionJournal>();
+        if (!sessionJournal->is_open()) {
+            sessionJournal.reset();
+        }
+    } else {
+        sessionJournal.reset();
+    }
+}
+
+size_t CommandStack::get_undo_journaled_steps() const {
+    return std::count_if(undoStack.begin(), undoStack.end(), [](const UndoEntry &entry) { return !entry.command; });
+}
+
+size_t CommandStack::get_undo_instruction_count() const {
+    size_t count = 0;
+    for (const auto &entry : undoStack) {
+        if (entry.command) {
+            count += entry.command->instruction_count();
+        }
+    }
+    return count;
 }
 
 struct UndoCommand : public Command {
@@ -76,8 +480,19 @@ bool UndoCommand::do_it() {
     CommandStack &commandStack = CommandStack::get_instance();
     // TODO : move into stacK ??
     if (commandStack.undoStackPos > 0) {
+        // an entry that can't be read back stays the next one to undo
+        Command *command = commandStack._resident_command(commandStack.undoStackPos - 1);
+        if (!command) {
+            return false;
+        }
         commandStack.undoStackPos--;
-        commandStack.undoStack[commandStack.undoStackPos]->undo_it();
+        if (commandStack.sessionJournal) {
+            commandStack.sessionJournal->write_undo();
+        }
+        if (!commandStack._begin_replay(command, true)) {
+            command->undo_it();
+        }
+        commandStack._evict_over_budget();
     }
     return false;// Should never be stored in the stack
 }
@@ -89,8 +504,18 @@ bool RedoCommand::do_it() {
     // TODO : move into stacK ??
     CommandStack &commandStack = CommandStack::get_instance();
     if (commandStack.undoStackPos < commandStack.undoStack.size()) {
-        commandStack.undoStack[commandStack.undoStackPos]->do_it();
+        Command *command = commandStack._resident_command(commandStack.undoStackPos);
+        if (!command) {
+            return false;
+        }
+        if (!commandStack._begin_replay(command, false)) {
+            command->do_it();
+        }
         commandStack.undoStackPos++;
+        if (commandStack.sessionJournal) {
+            commandStack.sessionJournal->write_redo();
+        }
+        commandStack._evict_over_budget();
     }
 
     return false;// Should never be stored in the stack
@@ -103,8 +528,13 @@ bool ClearUndoRedoCommand::do_it() {
     CommandStack &commandStack = CommandStack::get_instance();
     commandStack.undoStackPos = 0;
     commandStack.undoStack.clear();
-    delete commandStack.lastCmd;
-    commandStack.lastCmd = nullptr;
+    commandStack.undoStackBytes = 0;
+    if (commandStack.undoJournal) {
+        commandStack.undoJournal->reset();
+    }
+    if (commandStack.sessionJournal) {
+        commandStack.sessionJournal->write_clear();
+    }
     return false;// Should never be stored in the stack
 }
 template void execute_after_draw<ClearUndoRedoCommand>();
@@ -137,8 +567,27 @@ template void execute_after_draw<UsdFunctionCall>(SdfLayerHandle layer, std::fun
 template void execute_after_draw<UsdFunctionCall>(UsdStageRefPtr stage, std::function<void()> func);
 
 // Should go in Commands.cpp ???
-void ExecuteCommands() {
+void execute_commands() {
     CommandStack::get_instance().execute_commands();
 }
 
+void begin_command_group() {
+    if (openGroupDepth++ == 0) {
+        openGroup = std::make_unique<CompositeCommand>();
+    }
+}
+
+void end_command_group() {
+    if (openGroupDepth == 0 || --openGroupDepth > 0) {
+        return;
+    }
+    // reset before pushing, the group goes in the queue
+    CompositeCommand *group = openGroup.release();
+    if (group->_pending.empty()) {
+        delete group;
+    } else {
+        CommandStack::get_instance().push_command(group);
+    }
+}
+
 }// namespace vox
\ No newline at end of file
@@ -6,12 +6,23 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
+#include <pxr/usd/sdf/changeBlock.h>
 
+#include "command_queue.h"
 #include "commands_impl.h"
+#include "session_journal.h"
+#include "undo_journal.h"
+#include "undo_layer_state_delegate.h"
 
 namespace vox {
+struct CompositeCommand;
+
 struct CommandStack {
     // Undo and Redo calls are implemented as commands.
     // We compile them in the CommandStack.cpp unit
@@ -19,6 +30,8 @@ struct CommandStack {
     friend struct RedoCommand;
     // Same for ClearUndoRedo
     friend struct ClearUndoRedoCommand;
+    // Collects the undo entries of its commands
+    friend struct CompositeCommand;
 
     //
     friend struct UsdFunctionCall;
@@ -26,40 +39,182 @@ struct CommandStack {
 
     static CommandStack &get_instance();
 
-    inline bool has_next_command() { return lastCmd != nullptr; }
-    inline void set_next_command(Command *command) { lastCmd = command; }
+    inline bool has_next_command() const { return !pendingCommands.empty(); }
+
+    /// Queue a command, executed after the frame is drawn. Can be called from any thread, the commands of a thread
+    /// are executed in the order they were pushed. The stack takes ownership of the command.
+    void push_command(Command *command);
 
-    // Execute next command and push it on the stack
+    // Execute the queued commands and push them on the stack
     void execute_commands();
 
+    /// The oldest commands are evicted once the undo stack holds more than maxSteps commands or more than
+    /// maxBytes of estimated footprint. The last command done is always kept.
+    void set_undo_budget(size_t maxBytes, size_t maxSteps);
+    [[nodiscard]] size_t get_undo_budget_bytes() const { return undoBudgetBytes; }
+    [[nodiscard]] size_t get_undo_budget_steps() const { return undoBudgetSteps; }
+
+    /// Estimated memory held by the commands of the undo stack
+    [[nodiscard]] size_t get_undo_memory_usage() const { return undoStackBytes; }
+    [[nodiscard]] size_t get_undo_steps() const { return undoStack.size(); }
+    [[nodiscard]] int get_undo_position() const { return undoStackPos; }
+    /// Layer instructions held in memory by the undo stack, journaled commands are not counted
+    [[nodiscard]] size_t get_undo_instruction_count() const;
+
+    /// Once over the byte budget, the layer commands the farthest from the current position are written to a
+    /// journal in the temp directory instead of being evicted, and read back when undo or redo reaches them.
+    /// Commands that can't be encoded stay in memory.
+    void set_undo_journal(bool enabled);
+    [[nodiscard]] bool is_undo_journal_enabled() const { return undoJournal != nullptr; }
+    [[nodiscard]] size_t get_undo_journal_size() const { return undoJournal ? undoJournal->size() : 0; }
+    [[nodiscard]] size_t get_undo_journaled_steps() const;
+
+    /// Append every undo entry to a session journal, to recover the edits if the editor crashes.
+    /// Disabling it removes the journal, it is done when the editor exits normally.
+    void set_session_journal(bool enabled);
+    [[nodiscard]] bool is_session_journal_enabled() const { return sessionJournal != nullptr; }
+
+    /// The undo or redo of a command replaying many instructions runs in time slices over several frames.
+    /// In between, the layers hold a half replayed undo or redo that the stage was not notified of. Nothing reads
+    /// the stage until the replay ends: the editor neither draws its widgets nor updates or renders the Hydra
+    /// viewport, and the commands pushed meanwhile wait for it. The stage only ever sees the whole undo or redo.
+    [[nodiscard]] bool is_replaying() const { return replay != nullptr; }
+    /// Fraction of the instructions of the current replay done
+    [[nodiscard]] float get_replay_progress() const;
+
+    /// An interactive edit of a layer spanning several frames, like a manipulator drag, stored as one undo entry
+    /// going from the values before the session to the last ones. The edits are made in update_edit_session, a
+    /// value set again overwrites the one recorded by the previous update instead of adding an instruction.
+    /// The commands pushed meanwhile wait for the end of the session, so a session not updated for a whole frame
+    /// is cancelled. No session starts during a replay. Returns the id of the session, 0 if none started.
+    /// The manipulators hold their session with a ScopedEditSession.
+    uint64_t begin_edit_session(const SdfLayerRefPtr &layer);
+    /// The session edits the edit target layer of the stage
+    uint64_t begin_edit_session(const UsdStageRefPtr &stage);
+    void update_edit_session(const std::function<void()> &edit);
+    /// Push the undo entry of the session, if it edited anything
+    void commit_edit_session();
+    /// Restore the values from before the session without making an undo entry
+    void cancel_edit_session();
+    [[nodiscard]] bool has_edit_session() const { return editSession != nullptr; }
+    [[nodiscard]] uint64_t get_edit_session_id() const { return editSession ? editSession->id : 0; }
+
 private:
+    struct UndoEntry {
+        /// null while the command is only in the journal
+        std::unique_ptr<Command> command;
+        size_t footprint = 0;
+
+        /// Set once the command is written, the record stays valid when it is read back as undo and redo
+        /// replay the same instructions
+        std::optional<UndoJournal::Record> journalRecord;
+        /// The layers edited by the journaled instructions, kept alive as the command would
+        std::vector<SdfLayerRefPtr> journalLayers;
+        bool journalable = true;
+    };
+
     // The undo stack should ultimately belong to an Editor, not be a global variable
-    using UndoStackT = std::vector<std::unique_ptr<Command>>;
+    using UndoStackT = std::deque<UndoEntry>;
     UndoStackT undoStack;
 
+    /// Sum of the footprints of the undo stack entries
+    size_t undoStackBytes = 0;
+    size_t undoBudgetBytes = size_t(1) << 30;
+    size_t undoBudgetSteps = 10000;
+
+    std::unique_ptr<UndoJournal> undoJournal;
+    std::unique_ptr<SessionJournal> sessionJournal;
+
     /// The pointer to the current command in the undo stack
     int undoStackPos = 0;
 
-    // Storing only one command per frame for now, easier to reason about.
-    Command *lastCmd = nullptr;
+    /// Commands waiting for the end of the frame
+    CommandQueue pendingCommands;
+
+    /// The composite command being executed, the undo entries go in it instead of the stack
+    CompositeCommand *activeGroup = nullptr;
+
+    struct Replay {
+        /// In the order they are replayed
+        std::vector<SdfCommandGroup *> groups;
+        bool undo = false;
+        size_t group = 0;
+        /// Instructions of the current group already replayed
+        size_t offset = 0;
+        size_t done = 0;
+        size_t total = 0;
+        /// Held until the replay ends, the notices of the whole undo or redo are sent then. It only defers the
+        /// notices, the values read from the layers in between are the half replayed ones, see is_replaying.
+        SdfChangeBlock changeBlock;
+    };
+    std::unique_ptr<Replay> replay;
+
+    struct EditSession {
+        SdfLayerRefPtr layer;
+        std::unique_ptr<SdfUndoRedoCommand> command;
+        /// Installed on the layer during the updates only
+        UndoRedoLayerStateDelegateRefPtr delegate;
+        uint64_t id = 0;
+        /// Frames ended since the last update
+        int idleFrames = 0;
+    };
+    std::unique_ptr<EditSession> editSession;
+    uint64_t lastEditSessionId = 0;
 
     /// The ProcessCommands function is called after the frame is rendered and displayed and execute the
     /// last command. The command passed here now belongs to this stack
     void _push_command(Command *cmd);
 
+    /// Drop the redo entries after undoStackPos
+    void _truncate_redo();
+
+    /// Journal then evict the oldest entries until the stack fits the budget
+    void _evict_over_budget();
+
+    /// Write entries to the journal until the stack fits the byte budget
+    void _journal_over_budget();
+    bool _journal_entry(UndoEntry &entry);
+
+    /// The command at index, read back from the journal if needed. Returns nullptr if it can't be read.
+    Command *_resident_command(size_t index);
+
+    /// Start the incremental undo or redo of command. Returns false if it must run at once, as it is small or
+    /// not only a replay of instructions.
+    bool _begin_replay(Command *command, bool undo);
+    /// Replay instructions until the time slice of the frame is spent
+    void _continue_replay();
+
 private:
     CommandStack();
     ~CommandStack();
-    static CommandStack *instance;
+};
+
+/// The edit session of a manipulator, held for the length of a drag. The session still open is committed when the
+/// handle is destroyed, and the calls on a session that was ended by something else are ignored.
+class ScopedEditSession {
+public:
+    ScopedEditSession() = default;
+    ~ScopedEditSession() { commit(); }
+
+    ScopedEditSession(const ScopedEditSession &) = delete;
+    ScopedEditSession &operator=(const ScopedEditSession &) = delete;
+
+    /// Commits the previous session of the handle first
+    void begin(const UsdStageRefPtr &stage);
+    void update(const std::function<void()> &edit);
+    void commit();
+    void cancel();
+
+private:
+    [[nodiscard]] bool _is_open() const;
+
+    uint64_t _id = 0;
 };
 
 /// Dispatching Commands.
 template<typename CommandClass, typename... ArgTypes>
 void execute_after_draw(ArgTypes... arguments) {
-    CommandStack &commandStack = CommandStack::get_instance();
-    if (!commandStack.has_next_command()) {
-        commandStack.set_next_command(new CommandClass(arguments...));
-    }
+    CommandStack::get_instance().push_command(new CommandClass(arguments...));
 }
 
 }// namespace vox
\ No newline at end of file
@@ -234,9 +234,16 @@ void execute_after_draw(FuncT &&func, const UsdGeomXformCommonAPI &api, ArgsT &&
 //// 2. UsdFunctionCall is not persistent, it creates another command and it destroyed after creating it.
 //// We could simply copy the handle/ref/weak/ptrs
 
-/// Process the commands waiting in the queue. Only one command would be waiting at the moment
+/// Process the commands waiting in the queue, in the order they were posted
 void execute_commands();
 
+///
+/// The commands posted by the calling thread between begin_command_group and end_command_group are executed in the
+/// same frame and stored as one undo entry. Groups can be nested, only the outermost one makes an entry.
+///
+void begin_command_group();
+void end_command_group();
+
 ///
 /// Allows to record one command spanning multiple frames.
 /// It is used in the manipulators, to record only one command for a translation/rotation etc.
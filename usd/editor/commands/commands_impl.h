@@ -19,12 +19,26 @@ struct Command {
     virtual ~Command() = default;
     virtual bool do_it() = 0;
     virtual bool undo_it() { return false; }
+
+    /// Estimated memory held by the command while it is in the undo stack
+    [[nodiscard]] virtual size_t footprint() const { return sizeof(*this); }
+
+    /// Number of recorded layer instructions held by the command
+    [[nodiscard]] virtual size_t instruction_count() const { return 0; }
+
+    /// The instructions whose replay is the undo, or the redo, of the command. nullptr when the command does
+    /// more than replaying instructions, it then can't be replayed over several frames.
+    [[nodiscard]] virtual SdfCommandGroup *replay_group(bool undo) { return nullptr; }
 };
 
 struct SdfLayerCommand : public Command {
     ~SdfLayerCommand() override = default;
     bool do_it() override = 0;
     bool undo_it() override;
+    [[nodiscard]] size_t footprint() const override { return sizeof(*this) + _undoCommands.footprint(); }
+    [[nodiscard]] size_t instruction_count() const override { return _undoCommands.instruction_count(); }
+    /// The redo runs the command again
+    [[nodiscard]] SdfCommandGroup *replay_group(bool undo) override { return undo ? &_undoCommands : nullptr; }
     SdfCommandGroup _undoCommands;
 };
 
@@ -32,6 +46,7 @@ struct SdfLayerCommand : public Command {
 struct SdfUndoRedoCommand : public SdfLayerCommand {
     bool do_it() override;
     bool undo_it() override;
+    [[nodiscard]] SdfCommandGroup *replay_group(bool) override { return &_undoCommands; }
 };
 
 // UsdFunctionCall is a transition command, it internally
@@ -180,6 +180,9 @@ struct LayerTextEdit : public SdfLayerCommand {
         return _layer->ImportFromString(_oldText);
     }
 
+    /// The undo reimports the text
+    [[nodiscard]] SdfCommandGroup *replay_group(bool) override { return nullptr; }
+
     SdfLayerRefPtr _layer;
     std::string _oldText;
     std::string _newText;
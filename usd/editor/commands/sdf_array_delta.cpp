@@ -0,0 +1,204 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "sdf_array_delta.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <pxr/base/gf/half.h>
+#include <pxr/base/gf/matrix2d.h>
+#include <pxr/base/gf/matrix3d.h>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/quatd.h>
+#include <pxr/base/gf/quatf.h>
+#include <pxr/base/gf/quath.h>
+#include <pxr/base/gf/vec2d.h>
+#include <pxr/base/gf/vec2f.h>
+#include <pxr/base/gf/vec2h.h>
+#include <pxr/base/gf/vec2i.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec3h.h>
+#include <pxr/base/gf/vec3i.h>
+#include <pxr/base/gf/vec4d.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/gf/vec4h.h>
+#include <pxr/base/gf/vec4i.h>
+#include <pxr/base/tf/token.h>
+#include <pxr/base/vt/array.h>
+#include "sdf_layer_instructions.h"
+
+namespace vox {
+namespace {
+// Element types of the arrays that are delta encoded, the other arrays are kept whole
+#define VOX_DELTA_ELEMENT_TYPES(X) \
+    X(bool)                        \
+    X(unsigned char)               \
+    X(int)                         \
+    X(unsigned int)                \
+    X(int64_t)                     \
+    X(uint64_t)                    \
+    X(GfHalf)                      \
+    X(float)                       \
+    X(double)                      \
+    X(GfVec2i)                     \
+    X(GfVec3i)                     \
+    X(GfVec4i)                     \
+    X(GfVec2h)                     \
+    X(GfVec3h)                     \
+    X(GfVec4h)                     \
+    X(GfVec2f)                     \
+    X(GfVec3f)                     \
+    X(GfVec4f)                     \
+    X(GfVec2d)                     \
+    X(GfVec3d)                     \
+    X(GfVec4d)                     \
+    X(GfQuath)                     \
+    X(GfQuatf)                     \
+    X(GfQuatd)                     \
+    X(GfMatrix2d)                  \
+    X(GfMatrix3d)                  \
+    X(GfMatrix4d)                  \
+    X(TfToken)                     \
+    X(std::string)
+
+// Below this size both arrays are cheap to keep
+constexpr size_t kMinElements = 64;
+// Unchanged elements between two changes are copied along rather than starting a new range
+constexpr size_t kMergeGap = 4;
+
+template<typename T>
+bool _patch(const ArrayDelta &delta, const VtValue &current, const VtValue &contents, VtValue &result) {
+    if (!current.IsHolding<VtArray<T>>() || current.UncheckedGet<VtArray<T>>().size() != delta.size()) {
+        return false;
+    }
+    VtArray<T> array = current.UncheckedGet<VtArray<T>>();
+    const T *source = contents.UncheckedGet<VtArray<T>>().cdata();
+    // detaching the array from the layer is the only full copy
+    T *data = array.data();
+    for (const auto &range : delta.ranges()) {
+        std::copy_n(source, range.count, data + range.begin);
+        source += range.count;
+    }
+    result = VtValue::Take(array);
+    return true;
+}
+
+template<typename T>
+bool _find_ranges(const VtArray<T> &previous, const VtArray<T> &next, std::vector<ArrayDelta::Range> &ranges) {
+    const size_t size = previous.size();
+    const T *before = previous.cdata();
+    const T *after = next.cdata();
+    if (before == after) {
+        return true;
+    }
+    size_t changed = 0;
+    for (size_t i = 0; i < size;) {
+        if (before[i] == after[i]) {
+            ++i;
+            continue;
+        }
+        size_t last = i;
+        for (size_t j = i + 1; j < size && j - last <= kMergeGap; ++j) {
+            if (!(before[j] == after[j])) {
+                last = j;
+            }
+        }
+        ranges.push_back({i, last + 1 - i});
+        changed += last + 1 - i;
+        if (changed > size / 2) {
+            return false;
+        }
+        i = last + 1;
+    }
+    return true;
+}
+
+template<typename T>
+VtValue _gather(const VtArray<T> &array, const std::vector<ArrayDelta::Range> &ranges, size_t count) {
+    VtArray<T> contents(count);
+    T *data = contents.data();
+    for (const auto &range : ranges) {
+        data = std::copy_n(array.cdata() + range.begin, range.count, data);
+    }
+    return VtValue::Take(contents);
+}
+}// namespace
+
+ArrayDelta::ArrayDelta(uint64_t size, std::vector<Range> ranges, VtValue previousContents, VtValue newContents,
+                       PatchFunc patch)
+    : _size(size), _ranges(std::move(ranges)), _previousContents(std::move(previousContents)),
+      _newContents(std::move(newContents)), _patch(patch) {}
+
+std::unique_ptr<ArrayDelta> ArrayDelta::make(const VtValue &previousValue, const VtValue &newValue) {
+#define VOX_MAKE_DELTA(T)                                                                       \
+    if (previousValue.IsHolding<VtArray<T>>()) {                                                \
+        if (!newValue.IsHolding<VtArray<T>>()) {                                                \
+            return nullptr;                                                                     \
+        }                                                                                       \
+        const auto &previous = previousValue.UncheckedGet<VtArray<T>>();                        \
+        const auto &next = newValue.UncheckedGet<VtArray<T>>();                                 \
+        std::vector<Range> ranges;                                                              \
+        if (previous.size() != next.size() || previous.size() < kMinElements ||                 \
+            !_find_ranges(previous, next, ranges)) {                                            \
+            return nullptr;                                                                     \
+        }                                                                                       \
+        size_t count = 0;                                                                       \
+        for (const auto &range : ranges) {                                                      \
+            count += range.count;                                                               \
+        }                                                                                       \
+        VtValue previousContents = _gather(previous, ranges, count);                            \
+        VtValue newContents = _gather(next, ranges, count);                                     \
+        return std::unique_ptr<ArrayDelta>(new ArrayDelta(previous.size(), std::move(ranges),   \
+                                                          std::move(previousContents),          \
+                                                          std::move(newContents), &_patch<T>)); \
+    }
+    VOX_DELTA_ELEMENT_TYPES(VOX_MAKE_DELTA)
+#undef VOX_MAKE_DELTA
+    return nullptr;
+}
+
+std::unique_ptr<ArrayDelta> ArrayDelta::restore(uint64_t size, std::vector<Range> ranges, VtValue previousContents,
+                                                VtValue newContents) {
+    uint64_t count = 0;
+    for (const auto &range : ranges) {
+        if (range.begin > size || range.count > size - range.begin) {
+            return nullptr;
+        }
+        count += range.count;
+    }
+#define VOX_RESTORE_DELTA(T)                                                                                    \
+    if (previousContents.IsHolding<VtArray<T>>()) {                                                             \
+        const auto &previous = previousContents.UncheckedGet<VtArray<T>>();                                     \
+        if (!newContents.IsHolding<VtArray<T>>() || previous.size() != count ||                                 \
+            newContents.UncheckedGet<VtArray<T>>().size() != count) {                                           \
+            return nullptr;                                                                                     \
+        }                                                                                                       \
+        return std::unique_ptr<ArrayDelta>(new ArrayDelta(size, std::move(ranges), std::move(previousContents), \
+                                                          std::move(newContents), &_patch<T>));                 \
+    }
+    VOX_DELTA_ELEMENT_TYPES(VOX_RESTORE_DELTA)
+#undef VOX_RESTORE_DELTA
+    return nullptr;
+}
+
+bool ArrayDelta::apply(const VtValue &current, bool undo, VtValue &result) const {
+    if (!_patch(*this, current, undo ? _previousContents : _newContents, result)) {
+        std::cerr << "ERROR: the array to patch is not the one the edit was recorded on, " << current.GetTypeName()
+                  << " of " << (current.IsArrayValued() ? current.GetArraySize() : 0) << " elements" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t ArrayDelta::footprint() const {
+    return sizeof(*this) + _ranges.capacity() * sizeof(Range) + vt_value_footprint(_previousContents) +
+           vt_value_footprint(_newContents);
+}
+
+}// namespace vox
@@ -0,0 +1,62 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <pxr/base/vt/value.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace vox {
+/// Change between two arrays of the same type and size: the ranges of elements which differ, with their previous
+/// and new contents. Undo instructions keep it instead of both arrays when only a few elements were edited.
+class ArrayDelta {
+public:
+    struct Range {
+        uint64_t begin;
+        uint64_t count;
+    };
+
+    /// The delta from previousValue to newValue. nullptr when they are not arrays of the same supported type and
+    /// size, when the arrays are small, or when most of the elements changed and the full copies are kept instead.
+    static std::unique_ptr<ArrayDelta> make(const VtValue &previousValue, const VtValue &newValue);
+
+    /// Rebuild a delta read back from a buffer, nullptr if the contents don't match the ranges
+    static std::unique_ptr<ArrayDelta> restore(uint64_t size, std::vector<Range> ranges, VtValue previousContents,
+                                               VtValue newContents);
+
+    /// Write the previous contents, or the new ones, over current which is the array after the edit, or before.
+    /// Returns false if current is not an array of the type and size of the delta.
+    bool apply(const VtValue &current, bool undo, VtValue &result) const;
+
+    [[nodiscard]] uint64_t size() const { return _size; }
+    [[nodiscard]] const std::vector<Range> &ranges() const { return _ranges; }
+    /// The elements of the ranges one after the other, in an array of the type of the delta
+    [[nodiscard]] const VtValue &previous_contents() const { return _previousContents; }
+    [[nodiscard]] const VtValue &new_contents() const { return _newContents; }
+
+    /// Estimated memory held, the object included
+    [[nodiscard]] size_t footprint() const;
+
+private:
+    using PatchFunc = bool (*)(const ArrayDelta &delta, const VtValue &current, const VtValue &contents,
+                               VtValue &result);
+
+    ArrayDelta(uint64_t size, std::vector<Range> ranges, VtValue previousContents, VtValue newContents,
+               PatchFunc patch);
+
+    uint64_t _size;
+    std::vector<Range> _ranges;
+    VtValue _previousContents;
+    VtValue _newContents;
+    /// Copies contents into an array of the type of the delta
+    PatchFunc _patch;
+};
+
+}// namespace vox
@@ -4,23 +4,146 @@
 //  personal capacity and am not conveying any rights to any intellectual
 //  property of any third parties.
 
+#include <algorithm>
+#include <functional>
 #include <ranges>
+#include <type_traits>
 #include "sdf_command_group.h"
 #include "sdf_layer_instructions.h"
 
 namespace vox {
+namespace {
+// how many instructions are searched back for one to merge with
+constexpr size_t kCoalesceLookBack = 8;
+
+// Instructions writing the same value: the later one overrides the earlier one.
+// They belong to the same group, so the interned indices can be compared.
+bool _same_target(const UndoRedoSetField &a, const UndoRedoSetField &b) {
+    return a._layer == b._layer && a._path == b._path && a._fieldName == b._fieldName;
+}
+
+bool _same_target(const UndoRedoSetFieldDictValueByKey &a, const UndoRedoSetFieldDictValueByKey &b) {
+    return a._layer == b._layer && a._path == b._path && a._fieldName == b._fieldName && a._keyPath == b._keyPath;
+}
+
+bool _same_target(const UndoRedoSetTimeSample &a, const UndoRedoSetTimeSample &b) {
+    return a._layer == b._layer && a._path == b._path && a._timeCode == b._timeCode;
+}
+
+// Instructions of the same type that can be reordered, so the search can go past them
+bool _independent(const UndoRedoSetField &a, const UndoRedoSetField &b) {
+    return !_same_target(a, b);
+}
+
+bool _independent(const UndoRedoSetFieldDictValueByKey &a, const UndoRedoSetFieldDictValueByKey &b) {
+    // key paths nest, a different key of the same dictionary might still overlap
+    return a._layer != b._layer || a._path != b._path || a._fieldName != b._fieldName;
+}
+
+bool _independent(const UndoRedoSetTimeSample &a, const UndoRedoSetTimeSample &b) {
+    return !_same_target(a, b);
+}
+
+// field of the edit keys of the time samples
+constexpr InternTable::Index kTimeSampleField = ~InternTable::Index(0);
+
+template<typename InstructionT>
+constexpr bool _is_coalescable = std::is_same_v<InstructionT, UndoRedoSetField> ||
+                                 std::is_same_v<InstructionT, UndoRedoSetFieldDictValueByKey> ||
+                                 std::is_same_v<InstructionT, UndoRedoSetTimeSample>;
+}// namespace
+
 bool SdfCommandGroup::is_empty() const { return _instructions.empty(); }
 
-void SdfCommandGroup::clear() { _instructions.clear(); }
+void SdfCommandGroup::clear() {
+    _instructions.clear();
+    _lastEdits.clear();
+}
+
+size_t SdfCommandGroup::_EditKeyHash::operator()(const _EditKey &key) const {
+    size_t hash = std::hash<double>()(key.time);
+    for (const InternTable::Index index : {key.layer, key.path, key.field}) {
+        hash ^= index + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+void SdfCommandGroup::set_merge_edits(bool merge) {
+    _mergeEdits = merge;
+    _lastEdits.clear();
+}
+
+template<typename InstructionT>
+bool SdfCommandGroup::_coalesce(InstructionT &inst) {
+    const size_t last = _instructions.size() - std::min(_instructions.size(), kCoalesceLookBack);
+    for (size_t index = _instructions.size(); index > last; --index) {
+        auto *previous = _instructions.get_if<InstructionT>(index - 1);
+        if (!previous) {
+            return false;
+        }
+        if (_same_target(*previous, inst)) {
+            if constexpr (requires { previous->delta(); }) {
+                // compacted, the value from before the first edit is only kept for the changed elements
+                if (previous->delta()) {
+                    return false;
+                }
+            }
+            // keep the value from before the first edit, and the last value
+            previous->_newValue = std::move(inst._newValue);
+            return true;
+        }
+        if (!_independent(*previous, inst)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+template<typename InstructionT>
+bool SdfCommandGroup::_merge(InstructionT &inst) {
+    _EditKey key{inst._layer, inst._path, kTimeSampleField, 0.0};
+    if constexpr (std::is_same_v<InstructionT, UndoRedoSetTimeSample>) {
+        key.time = inst._timeCode;
+    } else {
+        if (_instructions.table().token(inst._fieldName) == SdfFieldKeys->TimeSamples) {
+            // overlaps every time sample of the path
+            _lastEdits.clear();
+            return false;
+        }
+        key.field = inst._fieldName;
+    }
+    auto [found, inserted] = _lastEdits.try_emplace(key, _instructions.size());
+    if (inserted) {
+        return false;
+    }
+    // only other values were set since, they don't depend on this one
+    auto *previous = _instructions.get_if<InstructionT>(found->second);
+    if (previous && _same_target(*previous, inst)) {
+        if constexpr (requires { previous->delta(); }) {
+            if (previous->delta()) {
+                found->second = _instructions.size();
+                return false;
+            }
+        }
+        previous->_newValue = std::move(inst._newValue);
+        return true;
+    }
+    found->second = _instructions.size();
+    return false;
+}
 
 template<typename InstructionT>
 void SdfCommandGroup::store_instruction(InstructionT inst) {
-    // TODO: specialize by InstructionT type to compact the instructions in the command,
-    // typically we don't want to store thousand of setField instruction where only the last one matters
-    // One optim would be to look for the previous instruction, check if it is a setfield on the same path, same layer ?
-    // Update the latest instruction instead of inserting a new instruction
-    // As StoreInstruction is templatized, it is possible to specialize it.
-    _instructions.emplace_back(std::move(inst));
+    // Interactive edits set the same fields every frame, only the last value matters
+    if constexpr (_is_coalescable<InstructionT>) {
+        if (_mergeEdits ? _merge(inst) : _coalesce(inst)) {
+            return;
+        }
+    } else if (_mergeEdits) {
+        // the specs changed, the values set before can't be moved past them
+        _lastEdits.clear();
+    }
+    _instructions.push_back(std::move(inst));
 }
 
 template void SdfCommandGroup::store_instruction<UndoRedoSetField>(UndoRedoSetField inst);
@@ -34,18 +157,34 @@ template void SdfCommandGroup::store_instruction<UndoRedoPushChild<SdfPath>>(Und
 template void SdfCommandGroup::store_instruction<UndoRedoPopChild<TfToken>>(UndoRedoPopChild<TfToken> inst);
 template void SdfCommandGroup::store_instruction<UndoRedoPopChild<SdfPath>>(UndoRedoPopChild<SdfPath> inst);
 
+void SdfCommandGroup::end_recording() {
+    // Large arrays edited in a few places are kept as the changed ranges
+    _instructions.for_each([](auto &instruction) {
+        if constexpr (requires { instruction.compact(); }) {
+            instruction.compact();
+        }
+    });
+    _instructions.table().release_lookup();
+}
+
 // Call all the functions stored in _commands in reverse order
 void SdfCommandGroup::undo_it() {
     SdfChangeBlock block;
-    for (auto cmd = _instructions.rbegin(); cmd != _instructions.rend(); ++cmd) {
-        cmd->undo_it();
-    }
+    _instructions.undo_all();
 }
 
 void SdfCommandGroup::do_it() {
     SdfChangeBlock block;
-    for (auto &cmd : _instructions) {
-        cmd.do_it();
+    _instructions.do_all();
+}
+
+void SdfCommandGroup::replay(bool undo, size_t offset, size_t count) {
+    if (undo) {
+        // the undo starts from the last instruction
+        const size_t end = _instructions.size() - offset;
+        _instructions.undo_range(end - count, end);
+    } else {
+        _instructions.do_range(offset, offset + count);
     }
 }
 
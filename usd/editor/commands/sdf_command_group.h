@@ -6,61 +6,13 @@
 
 #pragma once
 
+#include <span>
+#include <unordered_map>
+#include <utility>
 #include <vector>
-#include <functional>
-#include <memory>
-#include <iostream>
+#include "sdf_instruction_buffer.h"
 
 namespace vox {
-class InstructionWrapper {
-public:
-    template<typename InstructionT>
-    explicit InstructionWrapper(InstructionT &&instruction)
-        : _ref(std::make_unique<Storage<InstructionT>>(std::forward<InstructionT>(instruction))) {
-        _ref->show_it();
-    }
-
-    void do_it() const {
-        _ref->do_it();
-    }
-
-    void undo_it() const {
-        _ref->undo_it();
-    }
-
-    void show_it() const {
-        _ref->show_it();
-    }
-
-    struct Interface {
-        virtual ~Interface() = default;
-        virtual void do_it() = 0;
-        virtual void undo_it() = 0;
-        virtual void show_it() = 0;
-    };
-
-    template<typename InstructionT>
-    struct Storage : Interface {
-        explicit Storage(InstructionT &&inst) : _data(std::move(inst)) {
-        }
-        ~Storage() override = default;
-
-        void do_it() override {
-            _data.do_it();
-        }
-
-        void undo_it() override {
-            _data.undo_it();
-        }
-
-        void show_it() override {}
-
-        InstructionT _data;
-    };
-
-    std::unique_ptr<Interface> _ref;
-};
-
 class SdfCommandGroup {
 public:
     SdfCommandGroup() = default;
@@ -70,15 +22,71 @@ public:
     [[nodiscard]] bool is_empty() const;
     void clear();
 
+    /// Estimated memory held by the recorded instructions
+    [[nodiscard]] size_t footprint() const { return _instructions.footprint(); }
+
+    [[nodiscard]] size_t instruction_count() const { return _instructions.size(); }
+
+    /// The layers edited by the recorded instructions
+    [[nodiscard]] const std::vector<SdfLayerRefPtr> &layers() const { return _instructions.table().layers(); }
+
+    /// Compact the recorded instructions and free what is only needed while recording. The group can still be
+    /// recorded into afterwards, the compacted instructions are then not merged with the new ones.
+    void end_recording();
+
+    /// While merging, a value edited again overwrites the instruction which recorded it in place, however far
+    /// back it is, unless the specs or an overlapping value were changed since. Used by the edit sessions which
+    /// set the same values every frame.
+    void set_merge_edits(bool merge);
+
     /// Run the commands as an undo
     void do_it();
     void undo_it();
 
+    /// Run count instructions of a redo, or of an undo, from the offset-th one in the order of the replay.
+    /// A replay split in several calls doesn't open a change block, the caller holds one for the whole replay.
+    void replay(bool undo, size_t offset, size_t count);
+
     template<typename InstructionT>
     void store_instruction(InstructionT);
 
+    /// Construct an instruction referring to the intern table of the group and store it
+    template<typename InstructionT, typename... ArgsT>
+    void emplace_instruction(ArgsT &&...args) {
+        store_instruction(InstructionT(_instructions.table(), std::forward<ArgsT>(args)...));
+    }
+
+    friend bool serialize_command_group(const SdfCommandGroup &group, std::vector<SdfLayerRefPtr> &layers,
+                                        std::vector<char> &out);
+    friend bool deserialize_command_group(std::span<const char> in, const std::vector<SdfLayerRefPtr> &layers,
+                                          SdfCommandGroup &group);
+
 private:
-    std::vector<InstructionWrapper> _instructions;
+    /// Merge inst into a previous instruction writing the same value, returns true if it was merged
+    template<typename InstructionT>
+    bool _coalesce(InstructionT &inst);
+    template<typename InstructionT>
+    bool _merge(InstructionT &inst);
+
+    InstructionBuffer _instructions;
+
+    /// A value set by the instructions: a field of a spec, or a time sample. A dictionary field edited by key
+    /// shares the key of the field, as their values overlap.
+    struct _EditKey {
+        InternTable::Index layer;
+        InternTable::Index path;
+        InternTable::Index field;
+        double time;
+
+        bool operator==(const _EditKey &) const = default;
+    };
+    struct _EditKeyHash {
+        size_t operator()(const _EditKey &key) const;
+    };
+
+    bool _mergeEdits = false;
+    /// While merging, the last instruction setting each value
+    std::unordered_map<_EditKey, size_t, _EditKeyHash> _lastEdits;
 };
 
 }// namespace vox
\ No newline at end of file
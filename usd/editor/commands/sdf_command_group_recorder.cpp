@@ -21,6 +21,7 @@ SdfCommandGroupRecorder::SdfCommandGroupRecorder(SdfCommandGroup &undoCommands,
 
 SdfCommandGroupRecorder::~SdfCommandGroupRecorder() {
     unset_undo_state_delegates();
+    _undoCommands.end_recording();
 }
 
 void SdfCommandGroupRecorder::set_undo_state_delegates() {
@@ -0,0 +1,840 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "sdf_command_serializer.h"
+
+#include <algorithm>
+#include <memory>
+#include <pxr/base/gf/half.h>
+#include <pxr/base/gf/matrix2d.h>
+#include <pxr/base/gf/matrix3d.h>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/quatd.h>
+#include <pxr/base/gf/quatf.h>
+#include <pxr/base/gf/quath.h>
+#include <pxr/base/gf/vec2d.h>
+#include <pxr/base/gf/vec2f.h>
+#include <pxr/base/gf/vec2h.h>
+#include <pxr/base/gf/vec2i.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec3h.h>
+#include <pxr/base/gf/vec3i.h>
+#include <pxr/base/gf/vec4d.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/gf/vec4h.h>
+#include <pxr/base/gf/vec4i.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/dictionary.h>
+#include <pxr/usd/sdf/assetPath.h>
+#include <pxr/usd/sdf/data.h>
+#include <pxr/usd/sdf/listOp.h>
+#include <pxr/usd/sdf/payload.h>
+#include <pxr/usd/sdf/reference.h>
+#include <pxr/usd/sdf/types.h>
+
+namespace vox {
+namespace {
+// Plain data types, the tag of each type is followed by the tag of its array.
+// New types go at the end as the tags are written in the buffers.
+#define VOX_SERIALIZED_POD_TYPES(X) \
+    X(bool, Bool)                   \
+    X(unsigned char, UChar)         \
+    X(int, Int)                     \
+    X(unsigned int, UInt)           \
+    X(int64_t, Int64)               \
+    X(uint64_t, UInt64)             \
+    X(GfHalf, Half)                 \
+    X(float, Float)                 \
+    X(double, Double)               \
+    X(GfVec2i, Vec2i)               \
+    X(GfVec3i, Vec3i)               \
+    X(GfVec4i, Vec4i)               \
+    X(GfVec2h, Vec2h)               \
+    X(GfVec3h, Vec3h)               \
+    X(GfVec4h, Vec4h)               \
+    X(GfVec2f, Vec2f)               \
+    X(GfVec3f, Vec3f)               \
+    X(GfVec4f, Vec4f)               \
+    X(GfVec2d, Vec2d)               \
+    X(GfVec3d, Vec3d)               \
+    X(GfVec4d, Vec4d)               \
+    X(GfQuath, Quath)               \
+    X(GfQuatf, Quatf)               \
+    X(GfQuatd, Quatd)               \
+    X(GfMatrix2d, Matrix2d)         \
+    X(GfMatrix3d, Matrix3d)         \
+    X(GfMatrix4d, Matrix4d)         \
+    X(SdfSpecifier, Specifier)      \
+    X(SdfVariability, Variability)  \
+    X(SdfPermission, Permission)
+
+enum class ValueTag : uint8_t {
+    Empty,
+    String,
+    Token,
+    Path,
+    AssetPath,
+    Dictionary,
+    TimeSamples,
+    StringArray,
+    TokenArray,
+    TokenVector,
+    PathVector,
+#define VOX_POD_TAG(T, Name) Name, Name##Array,
+    VOX_SERIALIZED_POD_TYPES(VOX_POD_TAG)
+#undef VOX_POD_TAG
+    // the metadata of the specs captured by a DeleteSpec
+    TokenListOp,
+    PathListOp,
+    StringListOp,
+    ReferenceListOp,
+    PayloadListOp,
+    VariantSelectionMap,
+};
+
+template<typename T>
+void _write_array(BinaryWriter &writer, const VtArray<T> &array) {
+    writer.write_pod(uint64_t(array.size()));
+    writer.write_bytes(array.cdata(), array.size() * sizeof(T));
+}
+
+template<typename T>
+bool _read_scalar(BinaryReader &reader, VtValue &value) {
+    T scalar;
+    if (!reader.read_pod(scalar)) {
+        return false;
+    }
+    value = scalar;
+    return true;
+}
+
+template<typename T>
+bool _read_array(BinaryReader &reader, VtValue &value) {
+    uint64_t size = 0;
+    if (!reader.read_pod(size) || size > reader.remaining() / sizeof(T)) {
+        return false;
+    }
+    VtArray<T> array(size);
+    if (!reader.read_bytes(array.data(), size * sizeof(T))) {
+        return false;
+    }
+    value = VtValue::Take(array);
+    return true;
+}
+
+// Containers of strings, tokens or paths are written element by element
+template<typename ContainerT, typename WriteFuncT>
+void _write_elements(BinaryWriter &writer, const ContainerT &container, WriteFuncT &&write) {
+    writer.write_pod(uint64_t(container.size()));
+    for (const auto &element : container) {
+        (writer.*write)(element);
+    }
+}
+
+template<typename ContainerT, typename ReadFuncT>
+bool _read_elements(BinaryReader &reader, VtValue &value, ReadFuncT &&read) {
+    uint64_t size = 0;
+    if (!reader.read_pod(size) || size > reader.remaining() / sizeof(uint64_t)) {
+        return false;
+    }
+    ContainerT container(size);
+    for (auto &element : container) {
+        if (!(reader.*read)(element)) {
+            return false;
+        }
+    }
+    value = VtValue::Take(container);
+    return true;
+}
+
+// The items of the list ops, a reference fails when its custom data holds an unsupported type
+bool _write_item(BinaryWriter &writer, const std::string &str) {
+    writer.write_string(str);
+    return true;
+}
+
+bool _write_item(BinaryWriter &writer, const TfToken &token) {
+    writer.write_token(token);
+    return true;
+}
+
+bool _write_item(BinaryWriter &writer, const SdfPath &path) {
+    writer.write_path(path);
+    return true;
+}
+
+bool _write_item(BinaryWriter &writer, const SdfReference &reference) {
+    writer.write_string(reference.GetAssetPath());
+    writer.write_path(reference.GetPrimPath());
+    writer.write_pod(reference.GetLayerOffset().GetOffset());
+    writer.write_pod(reference.GetLayerOffset().GetScale());
+    return writer.write_value(VtValue(reference.GetCustomData()));
+}
+
+bool _write_item(BinaryWriter &writer, const SdfPayload &payload) {
+    writer.write_string(payload.GetAssetPath());
+    writer.write_path(payload.GetPrimPath());
+    writer.write_pod(payload.GetLayerOffset().GetOffset());
+    writer.write_pod(payload.GetLayerOffset().GetScale());
+    return true;
+}
+
+bool _read_item(BinaryReader &reader, std::string &str) { return reader.read_string(str); }
+bool _read_item(BinaryReader &reader, TfToken &token) { return reader.read_token(token); }
+bool _read_item(BinaryReader &reader, SdfPath &path) { return reader.read_path(path); }
+
+bool _read_item(BinaryReader &reader, SdfReference &reference) {
+    std::string assetPath;
+    SdfPath primPath;
+    double offset = 0.0, scale = 1.0;
+    VtValue customData;
+    if (!reader.read_string(assetPath) || !reader.read_path(primPath) || !reader.read_pod(offset) ||
+        !reader.read_pod(scale) || !reader.read_value(customData) || !customData.IsHolding<VtDictionary>()) {
+        return false;
+    }
+    reference = SdfReference(assetPath, primPath, SdfLayerOffset(offset, scale),
+                             customData.UncheckedGet<VtDictionary>());
+    return true;
+}
+
+bool _read_item(BinaryReader &reader, SdfPayload &payload) {
+    std::string assetPath;
+    SdfPath primPath;
+    double offset = 0.0, scale = 1.0;
+    if (!reader.read_string(assetPath) || !reader.read_path(primPath) || !reader.read_pod(offset) ||
+        !reader.read_pod(scale)) {
+        return false;
+    }
+    payload = SdfPayload(assetPath, primPath, SdfLayerOffset(offset, scale));
+    return true;
+}
+
+// An explicit list op only has its explicit items, the others have the five other lists
+template<typename T>
+bool _write_list_op(BinaryWriter &writer, const SdfListOp<T> &listOp) {
+    auto writeItems = [&writer](const std::vector<T> &items) {
+        writer.write_pod(uint64_t(items.size()));
+        return std::all_of(items.begin(), items.end(), [&writer](const T &item) { return _write_item(writer, item); });
+    };
+    writer.write_pod(listOp.IsExplicit());
+    if (listOp.IsExplicit()) {
+        return writeItems(listOp.GetExplicitItems());
+    }
+    return writeItems(listOp.GetAddedItems()) && writeItems(listOp.GetPrependedItems()) &&
+           writeItems(listOp.GetAppendedItems()) && writeItems(listOp.GetDeletedItems()) &&
+           writeItems(listOp.GetOrderedItems());
+}
+
+template<typename T>
+bool _read_list_op(BinaryReader &reader, VtValue &value) {
+    auto readItems = [&reader](std::vector<T> &items) {
+        uint64_t size = 0;
+        if (!reader.read_pod(size) || size > reader.remaining() / sizeof(uint64_t)) {
+            return false;
+        }
+        items.resize(size);
+        for (auto &item : items) {
+            if (!_read_item(reader, item)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    bool isExplicit = false;
+    if (!reader.read_pod(isExplicit)) {
+        return false;
+    }
+    SdfListOp<T> listOp;
+    std::vector<T> items[5];
+    if (isExplicit) {
+        if (!readItems(items[0])) {
+            return false;
+        }
+        listOp.SetExplicitItems(items[0]);
+    } else {
+        for (auto &list : items) {
+            if (!readItems(list)) {
+                return false;
+            }
+        }
+        listOp.SetAddedItems(items[0]);
+        listOp.SetPrependedItems(items[1]);
+        listOp.SetAppendedItems(items[2]);
+        listOp.SetDeletedItems(items[3]);
+        listOp.SetOrderedItems(items[4]);
+    }
+    value = VtValue::Take(listOp);
+    return true;
+}
+
+uint32_t _layer_index(const SdfLayerRefPtr &layer, std::vector<SdfLayerRefPtr> &layers) {
+    auto found = std::find(layers.begin(), layers.end(), layer);
+    if (found != layers.end()) {
+        return uint32_t(found - layers.begin());
+    }
+    layers.push_back(layer);
+    return uint32_t(layers.size() - 1);
+}
+
+// The values of an instruction, or the changed elements when it was compacted
+bool _write_values(BinaryWriter &writer, const VtValue &newValue, const VtValue &previousValue) {
+    const ArrayDelta *delta = compacted_delta(previousValue);
+    writer.write_pod(delta != nullptr);
+    if (!delta) {
+        return writer.write_value(newValue) && writer.write_value(previousValue);
+    }
+    writer.write_pod(delta->size());
+    writer.write_pod(uint64_t(delta->ranges().size()));
+    writer.write_bytes(delta->ranges().data(), delta->ranges().size() * sizeof(ArrayDelta::Range));
+    return writer.write_value(delta->previous_contents()) && writer.write_value(delta->new_contents());
+}
+
+bool _read_values(BinaryReader &reader, VtValue &newValue, VtValue &previousValue) {
+    bool compacted = false;
+    if (!reader.read_pod(compacted)) {
+        return false;
+    }
+    if (!compacted) {
+        return reader.read_value(newValue) && reader.read_value(previousValue);
+    }
+    uint64_t size = 0, rangeCount = 0;
+    if (!reader.read_pod(size) || !reader.read_pod(rangeCount) ||
+        rangeCount > reader.remaining() / sizeof(ArrayDelta::Range)) {
+        return false;
+    }
+    std::vector<ArrayDelta::Range> ranges(rangeCount);
+    VtValue previousContents, newContents;
+    if (!reader.read_bytes(ranges.data(), rangeCount * sizeof(ArrayDelta::Range)) ||
+        !reader.read_value(previousContents) || !reader.read_value(newContents)) {
+        return false;
+    }
+    std::shared_ptr<const ArrayDelta> delta =
+        ArrayDelta::restore(size, std::move(ranges), std::move(previousContents), std::move(newContents));
+    if (!delta) {
+        return false;
+    }
+    previousValue = VtValue(std::move(delta));
+    return true;
+}
+
+void _write_child(BinaryWriter &writer, const TfToken &token) { writer.write_token(token); }
+void _write_child(BinaryWriter &writer, const SdfPath &path) { writer.write_path(path); }
+bool _read_child(BinaryReader &reader, TfToken &token) { return reader.read_token(token); }
+bool _read_child(BinaryReader &reader, SdfPath &path) { return reader.read_path(path); }
+
+// The paths of the specs of a deleted subtree, which has no count
+struct _PathCollector : public SdfAbstractDataSpecVisitor {
+    bool VisitSpec(const SdfAbstractData &, const SdfPath &path) override {
+        paths.push_back(path);
+        return true;
+    }
+    void Done(const SdfAbstractData &) override {}
+
+    SdfPathVector paths;
+};
+
+// The handles are written in full, the indices of the intern table are only meaningful inside the group
+struct _InstructionWriter {
+    BinaryWriter &writer;
+    const InternTable &table;
+    std::vector<SdfLayerRefPtr> &layers;
+    bool ok = true;
+
+    template<typename InstructionT>
+    void header(const InstructionT &inst) {
+        writer.write_pod(InstructionTypeOf<InstructionT>::value);
+        writer.write_pod(_layer_index(table.layer(inst._layer), layers));
+    }
+
+    void operator()(const UndoRedoSetField &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._path));
+        writer.write_token(table.token(inst._fieldName));
+        ok = _write_values(writer, inst._newValue, inst._previousValue);
+    }
+
+    void operator()(const UndoRedoSetFieldDictValueByKey &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._path));
+        writer.write_token(table.token(inst._fieldName));
+        writer.write_token(table.token(inst._keyPath));
+        ok = writer.write_value(inst._newValue) && writer.write_value(inst._previousValue);
+    }
+
+    void operator()(const UndoRedoSetTimeSample &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._path));
+        writer.write_pod(inst._timeCode);
+        writer.write_pod(inst._isKeyFrame);
+        writer.write_pod(inst._hasTimeSamples);
+        ok = _write_values(writer, inst._newValue, inst._previousValue);
+    }
+
+    void operator()(const UndoRedoCreateSpec &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._path));
+        writer.write_pod(inst._specType);
+        writer.write_pod(inst._inert);
+    }
+
+    // The captured subtree is written in full, a spec with a value of an unsupported type fails the group
+    void operator()(const UndoRedoDeleteSpec &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._path));
+        writer.write_pod(inst._inert);
+        writer.write_pod(inst._deletedSpecType);
+        const SdfData &data = *get_pointer(inst._deletedData);
+        _PathCollector collector;
+        data.VisitSpecs(&collector);
+        writer.write_pod(uint64_t(collector.paths.size()));
+        for (const auto &path : collector.paths) {
+            writer.write_path(path);
+            writer.write_pod(data.GetSpecType(path));
+            const TfTokenVector fields = data.List(path);
+            writer.write_pod(uint64_t(fields.size()));
+            for (const auto &field : fields) {
+                writer.write_token(field);
+                if (!writer.write_value(data.Get(path, field))) {
+                    ok = false;
+                    return;
+                }
+            }
+        }
+    }
+
+    void operator()(const UndoRedoMoveSpec &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._oldPath));
+        writer.write_path(table.path(inst._newPath));
+    }
+
+    template<template<typename> class InstructionT, typename ValueT>
+    void operator()(const InstructionT<ValueT> &inst) {
+        header(inst);
+        writer.write_path(table.path(inst._parentPath));
+        writer.write_token(table.token(inst._fieldName));
+        _write_child(writer, table.get<ValueT>(inst._value));
+    }
+};
+
+template<typename InstructionT, typename ValueT>
+bool _read_child_instruction(BinaryReader &reader, const SdfLayerHandle &layer, InstructionBuffer &instructions) {
+    SdfPath parentPath;
+    TfToken fieldName;
+    ValueT value;
+    if (!reader.read_path(parentPath) || !reader.read_token(fieldName) || !_read_child(reader, value)) {
+        return false;
+    }
+    instructions.emplace_back<InstructionT>(layer, parentPath, fieldName, value);
+    return true;
+}
+
+bool _read_instruction(BinaryReader &reader, InstructionType type, const SdfLayerHandle &layer,
+                       InstructionBuffer &instructions) {
+    switch (type) {
+        case InstructionType::SetField: {
+            SdfPath path;
+            TfToken fieldName;
+            VtValue newValue, previousValue;
+            if (!reader.read_path(path) || !reader.read_token(fieldName) ||
+                !_read_values(reader, newValue, previousValue)) {
+                return false;
+            }
+            instructions.emplace_back<UndoRedoSetField>(layer, path, fieldName, std::move(newValue),
+                                                        std::move(previousValue));
+            return true;
+        }
+        case InstructionType::SetFieldDictValueByKey: {
+            SdfPath path;
+            TfToken fieldName, keyPath;
+            VtValue newValue, previousValue;
+            if (!reader.read_path(path) || !reader.read_token(fieldName) || !reader.read_token(keyPath) ||
+                !reader.read_value(newValue) || !reader.read_value(previousValue)) {
+                return false;
+            }
+            instructions.emplace_back<UndoRedoSetFieldDictValueByKey>(layer, path, fieldName, keyPath,
+                                                                      std::move(newValue), std::move(previousValue));
+            return true;
+        }
+        case InstructionType::SetTimeSample: {
+            SdfPath path;
+            double timeCode = 0.0;
+            bool isKeyFrame = false, hasTimeSamples = false;
+            VtValue newValue, previousValue;
+            if (!reader.read_path(path) || !reader.read_pod(timeCode) || !reader.read_pod(isKeyFrame) ||
+                !reader.read_pod(hasTimeSamples) || !_read_values(reader, newValue, previousValue)) {
+                return false;
+            }
+            instructions.emplace_back<UndoRedoSetTimeSample>(layer, path, timeCode, std::move(newValue),
+                                                             std::move(previousValue), isKeyFrame, hasTimeSamples);
+            return true;
+        }
+        case InstructionType::CreateSpec: {
+            SdfPath path;
+            SdfSpecType specType;
+            bool inert = false;
+            if (!reader.read_path(path) || !reader.read_pod(specType) || !reader.read_pod(inert)) {
+                return false;
+            }
+            instructions.emplace_back<UndoRedoCreateSpec>(layer, path, specType, inert);
+            return true;
+        }
+        case InstructionType::DeleteSpec: {
+            SdfPath path;
+            bool inert = false;
+            SdfSpecType deletedSpecType;
+            uint64_t specCount = 0;
+            if (!reader.read_path(path) || !reader.read_pod(inert) || !reader.read_pod(deletedSpecType) ||
+                !reader.read_pod(specCount) || specCount > reader.remaining() / sizeof(uint64_t)) {
+                return false;
+            }
+            SdfDataRefPtr deletedData = TfCreateRefPtr(new SdfData());
+            for (uint64_t i = 0; i < specCount; ++i) {
+                SdfPath specPath;
+                SdfSpecType specType;
+                uint64_t fieldCount = 0;
+                if (!reader.read_path(specPath) || !reader.read_pod(specType) || !reader.read_pod(fieldCount) ||
+                    fieldCount > reader.remaining() / sizeof(uint64_t)) {
+                    return false;
+                }
+                deletedData->CreateSpec(specPath, specType);
+                for (uint64_t j = 0; j < fieldCount; ++j) {
+                    TfToken field;
+                    VtValue value;
+                    if (!reader.read_token(field) || !reader.read_value(value)) {
+                        return false;
+                    }
+                    deletedData->Set(specPath, field, value);
+                }
+            }
+            instructions.emplace_back<UndoRedoDeleteSpec>(layer, path, inert, deletedSpecType, std::move(deletedData));
+            return true;
+        }
+        case InstructionType::MoveSpec: {
+            SdfPath oldPath, newPath;
+            if (!reader.read_path(oldPath) || !reader.read_path(newPath)) {
+                return false;
+            }
+            instructions.emplace_back<UndoRedoMoveSpec>(layer, oldPath, newPath);
+            return true;
+        }
+        case InstructionType::PushChildToken:
+            return _read_child_instruction<UndoRedoPushChild<TfToken>, TfToken>(reader, layer, instructions);
+        case InstructionType::PushChildPath:
+            return _read_child_instruction<UndoRedoPushChild<SdfPath>, SdfPath>(reader, layer, instructions);
+        case InstructionType::PopChildToken:
+            return _read_child_instruction<UndoRedoPopChild<TfToken>, TfToken>(reader, layer, instructions);
+        case InstructionType::PopChildPath:
+            return _read_child_instruction<UndoRedoPopChild<SdfPath>, SdfPath>(reader, layer, instructions);
+    }
+    return false;
+}
+}// namespace
+
+void BinaryWriter::write_string(const std::string &str) {
+    write_pod(uint64_t(str.size()));
+    write_bytes(str.data(), str.size());
+}
+
+bool BinaryWriter::write_value(const VtValue &value) {
+    if (value.IsEmpty()) {
+        write_pod(ValueTag::Empty);
+        return true;
+    }
+    if (value.IsHolding<std::string>()) {
+        write_pod(ValueTag::String);
+        write_string(value.UncheckedGet<std::string>());
+        return true;
+    }
+    if (value.IsHolding<TfToken>()) {
+        write_pod(ValueTag::Token);
+        write_token(value.UncheckedGet<TfToken>());
+        return true;
+    }
+    if (value.IsHolding<SdfPath>()) {
+        write_pod(ValueTag::Path);
+        write_path(value.UncheckedGet<SdfPath>());
+        return true;
+    }
+    if (value.IsHolding<SdfAssetPath>()) {
+        // the resolved path is not authored, it is found again by the resolver
+        write_pod(ValueTag::AssetPath);
+        write_string(value.UncheckedGet<SdfAssetPath>().GetAssetPath());
+        return true;
+    }
+    if (value.IsHolding<VtDictionary>()) {
+        const auto &dictionary = value.UncheckedGet<VtDictionary>();
+        write_pod(ValueTag::Dictionary);
+        write_pod(uint64_t(dictionary.size()));
+        for (const auto &[key, item] : dictionary) {
+            write_string(key);
+            if (!write_value(item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (value.IsHolding<SdfTimeSampleMap>()) {
+        const auto &samples = value.UncheckedGet<SdfTimeSampleMap>();
+        write_pod(ValueTag::TimeSamples);
+        write_pod(uint64_t(samples.size()));
+        for (const auto &[time, sample] : samples) {
+            write_pod(time);
+            if (!write_value(sample)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (value.IsHolding<VtStringArray>()) {
+        write_pod(ValueTag::StringArray);
+        _write_elements(*this, value.UncheckedGet<VtStringArray>(), &BinaryWriter::write_string);
+        return true;
+    }
+    if (value.IsHolding<VtTokenArray>()) {
+        write_pod(ValueTag::TokenArray);
+        _write_elements(*this, value.UncheckedGet<VtTokenArray>(), &BinaryWriter::write_token);
+        return true;
+    }
+    if (value.IsHolding<TfTokenVector>()) {
+        write_pod(ValueTag::TokenVector);
+        _write_elements(*this, value.UncheckedGet<TfTokenVector>(), &BinaryWriter::write_token);
+        return true;
+    }
+    if (value.IsHolding<SdfPathVector>()) {
+        write_pod(ValueTag::PathVector);
+        _write_elements(*this, value.UncheckedGet<SdfPathVector>(), &BinaryWriter::write_path);
+        return true;
+    }
+    if (value.IsHolding<SdfTokenListOp>()) {
+        write_pod(ValueTag::TokenListOp);
+        return _write_list_op(*this, value.UncheckedGet<SdfTokenListOp>());
+    }
+    if (value.IsHolding<SdfPathListOp>()) {
+        write_pod(ValueTag::PathListOp);
+        return _write_list_op(*this, value.UncheckedGet<SdfPathListOp>());
+    }
+    if (value.IsHolding<SdfStringListOp>()) {
+        write_pod(ValueTag::StringListOp);
+        return _write_list_op(*this, value.UncheckedGet<SdfStringListOp>());
+    }
+    if (value.IsHolding<SdfReferenceListOp>()) {
+        write_pod(ValueTag::ReferenceListOp);
+        return _write_list_op(*this, value.UncheckedGet<SdfReferenceListOp>());
+    }
+    if (value.IsHolding<SdfPayloadListOp>()) {
+        write_pod(ValueTag::PayloadListOp);
+        return _write_list_op(*this, value.UncheckedGet<SdfPayloadListOp>());
+    }
+    if (value.IsHolding<SdfVariantSelectionMap>()) {
+        const auto &selections = value.UncheckedGet<SdfVariantSelectionMap>();
+        write_pod(ValueTag::VariantSelectionMap);
+        write_pod(uint64_t(selections.size()));
+        for (const auto &[variantSet, variant] : selections) {
+            write_string(variantSet);
+            write_string(variant);
+        }
+        return true;
+    }
+#define VOX_WRITE_POD(T, Name)                                 \
+    if (value.IsHolding<T>()) {                                \
+        write_pod(ValueTag::Name);                             \
+        write_pod(value.UncheckedGet<T>());                    \
+        return true;                                           \
+    }                                                          \
+    if (value.IsHolding<VtArray<T>>()) {                       \
+        write_pod(ValueTag::Name##Array);                      \
+        _write_array(*this, value.UncheckedGet<VtArray<T>>()); \
+        return true;                                           \
+    }
+    VOX_SERIALIZED_POD_TYPES(VOX_WRITE_POD)
+#undef VOX_WRITE_POD
+    return false;
+}
+
+bool BinaryReader::read_string(std::string &str) {
+    uint64_t size = 0;
+    if (!read_pod(size) || size > remaining()) {
+        return false;
+    }
+    str.assign(_in.data() + _offset, size);
+    _offset += size;
+    return true;
+}
+
+bool BinaryReader::read_token(TfToken &token) {
+    std::string str;
+    if (!read_string(str)) {
+        return false;
+    }
+    token = TfToken(str);
+    return true;
+}
+
+bool BinaryReader::read_path(SdfPath &path) {
+    std::string str;
+    if (!read_string(str)) {
+        return false;
+    }
+    path = str.empty() ? SdfPath() : SdfPath(str);
+    return true;
+}
+
+bool BinaryReader::read_value(VtValue &value) {
+    ValueTag tag;
+    if (!read_pod(tag)) {
+        return false;
+    }
+    switch (tag) {
+        case ValueTag::Empty:
+            value = VtValue();
+            return true;
+        case ValueTag::String: {
+            std::string str;
+            if (!read_string(str)) {
+                return false;
+            }
+            value = VtValue::Take(str);
+            return true;
+        }
+        case ValueTag::Token: {
+            TfToken token;
+            if (!read_token(token)) {
+                return false;
+            }
+            value = token;
+            return true;
+        }
+        case ValueTag::Path: {
+            SdfPath path;
+            if (!read_path(path)) {
+                return false;
+            }
+            value = path;
+            return true;
+        }
+        case ValueTag::AssetPath: {
+            std::string assetPath;
+            if (!read_string(assetPath)) {
+                return false;
+            }
+            value = SdfAssetPath(assetPath);
+            return true;
+        }
+        case ValueTag::Dictionary: {
+            uint64_t size = 0;
+            if (!read_pod(size)) {
+                return false;
+            }
+            VtDictionary dictionary;
+            for (uint64_t i = 0; i < size; ++i) {
+                std::string key;
+                VtValue item;
+                if (!read_string(key) || !read_value(item)) {
+                    return false;
+                }
+                dictionary[key] = std::move(item);
+            }
+            value = VtValue::Take(dictionary);
+            return true;
+        }
+        case ValueTag::TimeSamples: {
+            uint64_t size = 0;
+            if (!read_pod(size)) {
+                return false;
+            }
+            SdfTimeSampleMap samples;
+            for (uint64_t i = 0; i < size; ++i) {
+                double time = 0.0;
+                VtValue sample;
+                if (!read_pod(time) || !read_value(sample)) {
+                    return false;
+                }
+                samples[time] = std::move(sample);
+            }
+            value = VtValue::Take(samples);
+            return true;
+        }
+        case ValueTag::StringArray:
+            return _read_elements<VtStringArray>(*this, value, &BinaryReader::read_string);
+        case ValueTag::TokenArray:
+            return _read_elements<VtTokenArray>(*this, value, &BinaryReader::read_token);
+        case ValueTag::TokenVector:
+            return _read_elements<TfTokenVector>(*this, value, &BinaryReader::read_token);
+        case ValueTag::PathVector:
+            return _read_elements<SdfPathVector>(*this, value, &BinaryReader::read_path);
+#define VOX_READ_POD(T, Name)                 \
+    case ValueTag::Name:                      \
+        return _read_scalar<T>(*this, value); \
+    case ValueTag::Name##Array:               \
+        return _read_array<T>(*this, value);
+            VOX_SERIALIZED_POD_TYPES(VOX_READ_POD)
+#undef VOX_READ_POD
+        case ValueTag::TokenListOp:
+            return _read_list_op<TfToken>(*this, value);
+        case ValueTag::PathListOp:
+            return _read_list_op<SdfPath>(*this, value);
+        case ValueTag::StringListOp:
+            return _read_list_op<std::string>(*this, value);
+        case ValueTag::ReferenceListOp:
+            return _read_list_op<SdfReference>(*this, value);
+        case ValueTag::PayloadListOp:
+            return _read_list_op<SdfPayload>(*this, value);
+        case ValueTag::VariantSelectionMap: {
+            uint64_t size = 0;
+            if (!read_pod(size)) {
+                return false;
+            }
+            SdfVariantSelectionMap selections;
+            for (uint64_t i = 0; i < size; ++i) {
+                std::string variantSet, variant;
+                if (!read_string(variantSet) || !read_string(variant)) {
+                    return false;
+                }
+                selections[variantSet] = std::move(variant);
+            }
+            value = VtValue::Take(selections);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool serialize_command_group(const SdfCommandGroup &group, std::vector<SdfLayerRefPtr> &layers, std::vector<char> &out) {
+    BinaryWriter writer(out);
+    writer.write_pod(uint64_t(group._instructions.size()));
+    _InstructionWriter instructionWriter{writer, group._instructions.table(), layers};
+    group._instructions.for_each([&instructionWriter](const auto &instruction) {
+        if (instructionWriter.ok) {
+            instructionWriter(instruction);
+        }
+    });
+    return instructionWriter.ok;
+}
+
+bool deserialize_command_group(std::span<const char> in, const std::vector<SdfLayerRefPtr> &layers,
+                               SdfCommandGroup &group) {
+    BinaryReader reader(in);
+    uint64_t count = 0;
+    if (!reader.read_pod(count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        InstructionType type;
+        uint32_t layerIndex = 0;
+        if (!reader.read_pod(type) || !reader.read_pod(layerIndex) || layerIndex >= layers.size()) {
+            return false;
+        }
+        if (!_read_instruction(reader, type, layers[layerIndex], group._instructions)) {
+            return false;
+        }
+    }
+    group.end_recording();
+    return reader.at_end();
+}
+
+}// namespace vox
@@ -0,0 +1,101 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <pxr/base/vt/value.h>
+#include <pxr/usd/sdf/path.h>
+#include "sdf_command_group.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace vox {
+/// Appends values to a byte buffer in the native layout. The buffers are only meant to be read back by the
+/// same build on the same machine.
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::vector<char> &out) : _out(out) {}
+
+    template<typename T>
+    void write_pod(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_bytes(const void *data, size_t size) {
+        const auto *bytes = static_cast<const char *>(data);
+        _out.insert(_out.end(), bytes, bytes + size);
+    }
+
+    void write_string(const std::string &str);
+    void write_token(const TfToken &token) { write_string(token.GetString()); }
+    void write_path(const SdfPath &path) { write_string(path.GetString()); }
+
+    /// Returns false if the type held by value is not supported, the buffer is then partially written
+    bool write_value(const VtValue &value);
+
+private:
+    std::vector<char> &_out;
+};
+
+/// Reads back what BinaryWriter wrote. Every read returns false once the input is exhausted.
+class BinaryReader {
+public:
+    explicit BinaryReader(std::span<const char> in) : _in(in) {}
+
+    template<typename T>
+    bool read_pod(T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return read_bytes(&value, sizeof(T));
+    }
+
+    bool read_bytes(void *data, size_t size) {
+        if (size > remaining()) {
+            return false;
+        }
+        std::memcpy(data, _in.data() + _offset, size);
+        _offset += size;
+        return true;
+    }
+
+    /// The next size bytes without copying them, empty if the input is too short
+    std::span<const char> read_span(size_t size) {
+        if (size > remaining()) {
+            return {};
+        }
+        auto span = _in.subspan(_offset, size);
+        _offset += size;
+        return span;
+    }
+
+    bool read_string(std::string &str);
+    bool read_token(TfToken &token);
+    bool read_path(SdfPath &path);
+    bool read_value(VtValue &value);
+
+    [[nodiscard]] size_t remaining() const { return _in.size() - _offset; }
+    [[nodiscard]] bool at_end() const { return _offset == _in.size(); }
+
+private:
+    std::span<const char> _in;
+    size_t _offset = 0;
+};
+
+/// Encode the instructions of a group. Layers are not written, they are indexed in layers which the caller keeps
+/// alive and passes back when decoding. Returns false when an instruction holds a value of an unsupported type.
+bool serialize_command_group(const SdfCommandGroup &group, std::vector<SdfLayerRefPtr> &layers, std::vector<char> &out);
+
+/// Append the instructions encoded in in to group
+bool deserialize_command_group(std::span<const char> in, const std::vector<SdfLayerRefPtr> &layers,
+                               SdfCommandGroup &group);
+
+}// namespace vox
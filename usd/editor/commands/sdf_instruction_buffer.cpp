@@ -0,0 +1,74 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "sdf_instruction_buffer.h"
+
+#include <algorithm>
+
+namespace vox {
+void InstructionBuffer::clear() {
+    // destroyed in reverse order of construction, like the vector of instructions it replaces
+    for (auto record = _records.rbegin(); record != _records.rend(); ++record) {
+        _visit(*record, [](auto &instruction) {
+            using T = std::decay_t<decltype(instruction)>;
+            instruction.~T();
+        });
+    }
+    _records.clear();
+    _table.clear();
+    _blocks.clear();
+    _cursor = nullptr;
+    _end = nullptr;
+}
+
+void InstructionBuffer::do_all() {
+    do_range(0, _records.size());
+}
+
+void InstructionBuffer::undo_all() {
+    undo_range(0, _records.size());
+}
+
+void InstructionBuffer::do_range(size_t begin, size_t end) {
+    for (size_t index = begin; index < end; ++index) {
+        _visit(_records[index], [this](auto &instruction) { instruction.do_it(_table); });
+    }
+}
+
+void InstructionBuffer::undo_range(size_t begin, size_t end) {
+    for (size_t index = end; index > begin; --index) {
+        _visit(_records[index - 1], [this](auto &instruction) { instruction.undo_it(_table); });
+    }
+}
+
+size_t InstructionBuffer::footprint() const {
+    size_t bytes = _blocks.size() * kBlockSize + _records.capacity() * sizeof(Record) + _table.footprint();
+    for (const auto &record : _records) {
+        // the instruction itself is in the arena already
+        _visit(record, [&bytes](const auto &instruction) { bytes += instruction.footprint() - sizeof(instruction); });
+    }
+    return bytes;
+}
+
+void *InstructionBuffer::_allocate(size_t size, size_t alignment) {
+    auto aligned = [alignment](std::byte *ptr) {
+        const auto address = reinterpret_cast<uintptr_t>(ptr);
+        return reinterpret_cast<std::byte *>((address + alignment - 1) & ~(uintptr_t(alignment) - 1));
+    };
+
+    auto *data = _cursor ? aligned(_cursor) : nullptr;
+    if (!data || data + size > _end) {
+        const size_t block_size = std::max(kBlockSize, size + alignment);
+        _blocks.push_back(std::make_unique<std::byte[]>(block_size));
+        _cursor = _blocks.back().get();
+        _end = _cursor + block_size;
+        data = aligned(_cursor);
+    }
+    _cursor = data + size;
+    return data;
+}
+
+}// namespace vox
@@ -0,0 +1,175 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "sdf_intern_table.h"
+#include "sdf_layer_instructions.h"
+
+namespace vox {
+enum class InstructionType : uint8_t {
+    SetField,
+    SetFieldDictValueByKey,
+    SetTimeSample,
+    CreateSpec,
+    DeleteSpec,
+    MoveSpec,
+    PushChildToken,
+    PushChildPath,
+    PopChildToken,
+    PopChildPath,
+};
+
+template<typename InstructionT>
+struct InstructionTypeOf;
+
+#define VOX_INSTRUCTION_TYPE(InstructionT, Type)                \
+    template<>                                                  \
+    struct InstructionTypeOf<InstructionT> {                    \
+        static constexpr InstructionType value = InstructionType::Type; \
+    };
+
+VOX_INSTRUCTION_TYPE(UndoRedoSetField, SetField)
+VOX_INSTRUCTION_TYPE(UndoRedoSetFieldDictValueByKey, SetFieldDictValueByKey)
+VOX_INSTRUCTION_TYPE(UndoRedoSetTimeSample, SetTimeSample)
+VOX_INSTRUCTION_TYPE(UndoRedoCreateSpec, CreateSpec)
+VOX_INSTRUCTION_TYPE(UndoRedoDeleteSpec, DeleteSpec)
+VOX_INSTRUCTION_TYPE(UndoRedoMoveSpec, MoveSpec)
+VOX_INSTRUCTION_TYPE(UndoRedoPushChild<TfToken>, PushChildToken)
+VOX_INSTRUCTION_TYPE(UndoRedoPushChild<SdfPath>, PushChildPath)
+VOX_INSTRUCTION_TYPE(UndoRedoPopChild<TfToken>, PopChildToken)
+VOX_INSTRUCTION_TYPE(UndoRedoPopChild<SdfPath>, PopChildPath)
+
+#undef VOX_INSTRUCTION_TYPE
+
+/// Instructions of a command group. They are constructed back to back in blocks of a bump arena,
+/// and dispatched with a switch on their type tag instead of a virtual call. The layers, paths and tokens
+/// they refer to are interned in a table shared by the instructions of the buffer.
+class InstructionBuffer {
+public:
+    InstructionBuffer() = default;
+    ~InstructionBuffer() { clear(); }
+
+    InstructionBuffer(const InstructionBuffer &) = delete;
+    InstructionBuffer &operator=(const InstructionBuffer &) = delete;
+
+    template<typename InstructionT>
+    void push_back(InstructionT &&instruction) {
+        using T = std::decay_t<InstructionT>;
+        void *data = _allocate(sizeof(T), alignof(T));
+        new (data) T(std::forward<InstructionT>(instruction));
+        _records.push_back({InstructionTypeOf<T>::value, data});
+    }
+
+    /// Construct an instruction in place, its constructor interns the handles in the table of the buffer
+    template<typename InstructionT, typename... ArgsT>
+    InstructionT &emplace_back(ArgsT &&...args) {
+        void *data = _allocate(sizeof(InstructionT), alignof(InstructionT));
+        auto *instruction = new (data) InstructionT(_table, std::forward<ArgsT>(args)...);
+        _records.push_back({InstructionTypeOf<InstructionT>::value, data});
+        return *instruction;
+    }
+
+    [[nodiscard]] InternTable &table() { return _table; }
+    [[nodiscard]] const InternTable &table() const { return _table; }
+
+    /// The instruction at index if it is an InstructionT, nullptr otherwise
+    template<typename InstructionT>
+    InstructionT *get_if(size_t index) const {
+        const auto &record = _records[index];
+        return record.type == InstructionTypeOf<InstructionT>::value ? static_cast<InstructionT *>(record.data) : nullptr;
+    }
+
+    [[nodiscard]] size_t size() const { return _records.size(); }
+    [[nodiscard]] bool empty() const { return _records.empty(); }
+
+    /// Destroy the instructions, release the arena and clear the table
+    void clear();
+
+    /// Run the instructions in order
+    void do_all();
+
+    /// Undo the instructions in reverse order
+    void undo_all();
+
+    /// Run the instructions of [begin, end) in order
+    void do_range(size_t begin, size_t end);
+
+    /// Undo the instructions of [begin, end) in reverse order
+    void undo_range(size_t begin, size_t end);
+
+    /// Call func on every instruction, in order
+    template<typename FuncT>
+    void for_each(FuncT &&func) const {
+        for (const auto &record : _records) {
+            _visit(record, func);
+        }
+    }
+
+    /// Estimated memory held: the arena, the records, the table and the payload of the instructions
+    [[nodiscard]] size_t footprint() const;
+
+private:
+    struct Record {
+        InstructionType type;
+        void *data;
+    };
+
+    template<typename FuncT>
+    static void _visit(const Record &record, FuncT &&func) {
+        switch (record.type) {
+            case InstructionType::SetField:
+                func(*static_cast<UndoRedoSetField *>(record.data));
+                break;
+            case InstructionType::SetFieldDictValueByKey:
+                func(*static_cast<UndoRedoSetFieldDictValueByKey *>(record.data));
+                break;
+            case InstructionType::SetTimeSample:
+                func(*static_cast<UndoRedoSetTimeSample *>(record.data));
+                break;
+            case InstructionType::CreateSpec:
+                func(*static_cast<UndoRedoCreateSpec *>(record.data));
+                break;
+            case InstructionType::DeleteSpec:
+                func(*static_cast<UndoRedoDeleteSpec *>(record.data));
+                break;
+            case InstructionType::MoveSpec:
+                func(*static_cast<UndoRedoMoveSpec *>(record.data));
+                break;
+            case InstructionType::PushChildToken:
+                func(*static_cast<UndoRedoPushChild<TfToken> *>(record.data));
+                break;
+            case InstructionType::PushChildPath:
+                func(*static_cast<UndoRedoPushChild<SdfPath> *>(record.data));
+                break;
+            case InstructionType::PopChildToken:
+                func(*static_cast<UndoRedoPopChild<TfToken> *>(record.data));
+                break;
+            case InstructionType::PopChildPath:
+                func(*static_cast<UndoRedoPopChild<SdfPath> *>(record.data));
+                break;
+        }
+    }
+
+    void *_allocate(size_t size, size_t alignment);
+
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> _blocks;
+    std::byte *_cursor{nullptr};
+    std::byte *_end{nullptr};
+    std::vector<Record> _records;
+    InternTable _table;
+};
+
+}// namespace vox
@@ -0,0 +1,75 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "sdf_intern_table.h"
+
+namespace vox {
+namespace {
+template<typename T, typename MapT>
+InternTable::Index _intern(const T &value, std::vector<T> &values, MapT &indices) {
+    if (indices.size() != values.size()) {
+        // the lookup was released after a recording
+        indices.clear();
+        indices.reserve(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            indices.emplace(values[i], InternTable::Index(i));
+        }
+    }
+    auto [found, inserted] = indices.try_emplace(value, InternTable::Index(values.size()));
+    if (inserted) {
+        values.push_back(value);
+    }
+    return found->second;
+}
+
+template<typename MapT>
+size_t _map_footprint(const MapT &indices) {
+    // a node per element holding the next pointer and the cached hash, plus the buckets
+    return indices.size() * (sizeof(typename MapT::value_type) + 2 * sizeof(void *)) +
+           indices.bucket_count() * sizeof(void *);
+}
+}// namespace
+
+InternTable::Index InternTable::intern(const SdfLayerHandle &layer) {
+    // a group edits a handful of layers
+    for (size_t i = 0; i < _layers.size(); ++i) {
+        if (get_pointer(_layers[i]) == get_pointer(layer)) {
+            return Index(i);
+        }
+    }
+    _layers.emplace_back(layer);
+    return Index(_layers.size() - 1);
+}
+
+InternTable::Index InternTable::intern(const SdfPath &path) {
+    return _intern(path, _paths, _pathIndices);
+}
+
+InternTable::Index InternTable::intern(const TfToken &token) {
+    return _intern(token, _tokens, _tokenIndices);
+}
+
+void InternTable::release_lookup() {
+    decltype(_pathIndices)().swap(_pathIndices);
+    decltype(_tokenIndices)().swap(_tokenIndices);
+    _paths.shrink_to_fit();
+    _tokens.shrink_to_fit();
+}
+
+void InternTable::clear() {
+    _layers.clear();
+    _paths.clear();
+    _tokens.clear();
+    _pathIndices.clear();
+    _tokenIndices.clear();
+}
+
+size_t InternTable::footprint() const {
+    return _layers.capacity() * sizeof(SdfLayerRefPtr) + _paths.capacity() * sizeof(SdfPath) +
+           _tokens.capacity() * sizeof(TfToken) + _map_footprint(_pathIndices) + _map_footprint(_tokenIndices);
+}
+
+}// namespace vox
@@ -0,0 +1,63 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <pxr/base/tf/token.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace vox {
+/// Layers, paths and tokens referred to by the instructions of a command group. Each one is stored once and the
+/// instructions keep its index instead of a handle, which is smaller and doesn't touch a reference count.
+class InternTable {
+public:
+    using Index = uint32_t;
+
+    Index intern(const SdfLayerHandle &layer);
+    Index intern(const SdfPath &path);
+    Index intern(const TfToken &token);
+
+    [[nodiscard]] const SdfLayerRefPtr &layer(Index index) const { return _layers[index]; }
+    [[nodiscard]] const SdfPath &path(Index index) const { return _paths[index]; }
+    [[nodiscard]] const TfToken &token(Index index) const { return _tokens[index]; }
+
+    [[nodiscard]] const std::vector<SdfLayerRefPtr> &layers() const { return _layers; }
+
+    /// The path or token at index, for the instructions templated on the child type
+    template<typename T>
+    [[nodiscard]] const T &get(Index index) const {
+        if constexpr (std::is_same_v<T, TfToken>) {
+            return _tokens[index];
+        } else {
+            return _paths[index];
+        }
+    }
+
+    /// Free the lookup maps once the recording is done, they are rebuilt if more values are interned
+    void release_lookup();
+
+    void clear();
+
+    /// Estimated memory held by the values and the lookup maps
+    [[nodiscard]] size_t footprint() const;
+
+private:
+    std::vector<SdfLayerRefPtr> _layers;
+    std::vector<SdfPath> _paths;
+    std::vector<TfToken> _tokens;
+
+    std::unordered_map<SdfPath, Index, SdfPath::Hash> _pathIndices;
+    std::unordered_map<TfToken, Index, TfToken::HashFunctor> _tokenIndices;
+};
+
+}// namespace vox
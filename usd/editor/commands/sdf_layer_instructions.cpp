@@ -8,6 +8,8 @@
 #include <utility>
 #include <pxr/usd/sdf/path.h>
 #include <pxr/usd/sdf/abstractData.h>
+#include <pxr/usd/sdf/schema.h>
+#include <pxr/usd/sdf/types.h>
 #include "sdf_layer_instructions.h"
 
 namespace vox {
@@ -21,8 +23,80 @@ void _copy_spec(const SdfAbstractData &src, SdfAbstractData *dst, const SdfPath
     const TfTokenVector &fields = src.List(path);
     TF_FOR_ALL(i, fields) { dst->Set(path, *i, src.Get(path, *i)); }
 }
+
+// Sum the footprint of every field of the visited specs
+struct _FootprintCounter : public SdfAbstractDataSpecVisitor {
+    bool VisitSpec(const SdfAbstractData &data, const SdfPath &path) override {
+        bytes += sizeof(SdfPath);
+        for (const auto &field : data.List(path)) {
+            bytes += sizeof(TfToken) + sizeof(VtValue) + vt_value_footprint(data.Get(path, field));
+        }
+        return true;
+    }
+    void Done(const SdfAbstractData &) override {}
+
+    size_t bytes = 0;
+};
+
+// Recreate the specs through the state delegate of the layer, when its data is not known
+struct _DelegateSpecCopier : public SdfAbstractDataSpecVisitor {
+    _DelegateSpecCopier(SdfLayerStateDelegateBasePtr delegate_, const SdfPath &root_, bool inert_)
+        : delegate(std::move(delegate_)), root(root_), inert(inert_) {}
+
+    bool VisitSpec(const SdfAbstractData &src, const SdfPath &path) override {
+        if (path != root) {
+            delegate->CreateSpec(path, src.GetSpecType(path), inert);
+        }
+        for (const auto &field : src.List(path)) {
+            delegate->SetField(path, field, src.Get(path, field));
+        }
+        return true;
+    }
+    void Done(const SdfAbstractData &) override {}
+
+    SdfLayerStateDelegateBasePtr delegate;
+    const SdfPath &root;
+    const bool inert;
+};
+
+size_t _data_footprint(const SdfDataRefPtr &data) {
+    _FootprintCounter counter;
+    data->VisitSpecs(&counter);
+    return counter.bytes;
+}
 }// namespace
 
+size_t vt_value_footprint(const VtValue &value) {
+    if (value.IsEmpty()) {
+        return 0;
+    }
+    if (value.IsHolding<std::string>()) {
+        return value.UncheckedGet<std::string>().capacity();
+    }
+    if (value.IsHolding<VtDictionary>()) {
+        size_t bytes = 0;
+        for (const auto &[key, item] : value.UncheckedGet<VtDictionary>()) {
+            bytes += sizeof(std::string) + key.capacity() + sizeof(VtValue) + vt_value_footprint(item);
+        }
+        return bytes;
+    }
+    if (value.IsHolding<SdfTimeSampleMap>()) {
+        size_t bytes = 0;
+        for (const auto &[time, sample] : value.UncheckedGet<SdfTimeSampleMap>()) {
+            bytes += sizeof(double) + sizeof(VtValue) + vt_value_footprint(sample);
+        }
+        return bytes;
+    }
+    if (value.IsArrayValued()) {
+        // the element size comes from the scalar type of the matching sdf value type
+        const auto typeName = SdfGetValueTypeNameForValue(value);
+        const size_t elementSize = typeName ? typeName.GetScalarType().GetType().GetSizeof() : 0;
+        return value.GetArraySize() * elementSize;
+    }
+    // other values are small or stored inline
+    return 0;
+}
+
 UndoRedoDeleteSpec::_SpecCopier::_SpecCopier(SdfAbstractData *dst_) : dst(dst_) {}
 
 bool UndoRedoDeleteSpec::_SpecCopier::VisitSpec(const SdfAbstractData &src, const SdfPath &path) {
@@ -32,29 +106,45 @@ bool UndoRedoDeleteSpec::_SpecCopier::VisitSpec(const SdfAbstractData &src, cons
 
 void UndoRedoDeleteSpec::_SpecCopier::Done(const SdfAbstractData &) {}
 
-UndoRedoDeleteSpec::UndoRedoDeleteSpec(const SdfLayerHandle &layer, const SdfPath &path, bool inert, SdfAbstractDataPtr layerData)
-    : _layer(layer), _path(path), _inert(inert), _deletedSpecType(_layer->GetSpecType(path)), _layerData(std::move(layerData)) {
+UndoRedoDeleteSpec::UndoRedoDeleteSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, bool inert,
+                                       SdfAbstractDataPtr layerData)
+    : _layer(table.intern(layer)), _path(table.intern(path)), _inert(inert), _layerData(std::move(layerData)),
+      _deletedSpecType(layer->GetSpecType(path)) {
     // TODO: is there a faster way of copying and restoring the data ?
     // This can be really slow on big scenes
     SdfChangeBlock changeBlock;
     _deletedData = TfCreateRefPtr(new SdfData());
     SdfLayer::TraversalFunction copyFunc = std::bind(&_copy_spec, std::cref(*get_pointer(_layerData)),
                                                      get_pointer(_deletedData), std::placeholders::_1);
-    _layer->Traverse(path, copyFunc);
+    layer->Traverse(path, copyFunc);
+    _deletedFootprint = _data_footprint(_deletedData);
 }
 
-void UndoRedoDeleteSpec::do_it() {
-    if (_layer && _layer->GetStateDelegate()) {
-        _layer->GetStateDelegate()->DeleteSpec(_path, _inert);
+UndoRedoDeleteSpec::UndoRedoDeleteSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, bool inert,
+                                       SdfSpecType deletedSpecType, SdfDataRefPtr deletedData)
+    : _layer(table.intern(layer)), _path(table.intern(path)), _inert(inert), _deletedSpecType(deletedSpecType),
+      _deletedData(std::move(deletedData)), _deletedFootprint(_data_footprint(_deletedData)) {}
+
+void UndoRedoDeleteSpec::do_it(const InternTable &table) {
+    const auto &layer = table.layer(_layer);
+    if (layer && layer->GetStateDelegate()) {
+        layer->GetStateDelegate()->DeleteSpec(table.path(_path), _inert);
     }
 }
 
-void UndoRedoDeleteSpec::undo_it() {
-    if (_layer && _layer->GetStateDelegate()) {
+void UndoRedoDeleteSpec::undo_it(const InternTable &table) {
+    const auto &layer = table.layer(_layer);
+    if (layer && layer->GetStateDelegate()) {
         SdfChangeBlock changeBlock;
-        _SpecCopier copier(get_pointer(_layerData));
-        _layer->GetStateDelegate()->CreateSpec(_path, _deletedSpecType, _inert);
-        _deletedData->VisitSpecs(&copier);
+        const SdfPath &path = table.path(_path);
+        layer->GetStateDelegate()->CreateSpec(path, _deletedSpecType, _inert);
+        if (_layerData) {
+            _SpecCopier copier(get_pointer(_layerData));
+            _deletedData->VisitSpecs(&copier);
+        } else {
+            _DelegateSpecCopier copier(layer->GetStateDelegate(), path, _inert);
+            _deletedData->VisitSpecs(&copier);
+        }
     }
 }
 
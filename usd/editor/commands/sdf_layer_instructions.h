@@ -7,133 +7,236 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <utility>
+#include <vector>
 #include <pxr/usd/sdf/abstractData.h>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/sdf/path.h>
 #include <pxr/usd/sdf/layerStateDelegate.h>
+#include "sdf_array_delta.h"
+#include "sdf_intern_table.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
 namespace vox {
+/// Estimated heap memory held by a value: array elements, strings, dictionaries and time samples.
+/// Array buffers shared with a layer are counted as well, as the value keeps them alive.
+size_t vt_value_footprint(const VtValue &value);
+
+// The instructions refer to their layer, paths and tokens by index in the intern table of their group,
+// it is passed to their constructor and to do_it and undo_it.
+
+/// A compacted value edit keeps its ArrayDelta in place of its previous value, its new value being empty.
+/// Null for the values of the edits which were not compacted.
+inline const ArrayDelta *compacted_delta(const VtValue &previousValue) {
+    using DeltaPtr = std::shared_ptr<const ArrayDelta>;
+    return previousValue.IsHolding<DeltaPtr>() ? previousValue.UncheckedGet<DeltaPtr>().get() : nullptr;
+}
+
 struct UndoRedoSetField {
-    UndoRedoSetField(const SdfLayerHandle &layer, SdfPath path, TfToken fieldName, VtValue newValue, VtValue previousValue)
-        : _layer(layer), _path(std::move(path)), _fieldName(std::move(fieldName)), _newValue(std::move(newValue)), _previousValue(std::move(previousValue)) {}
+    UndoRedoSetField(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, const TfToken &fieldName,
+                     VtValue newValue, VtValue previousValue)
+        : _layer(table.intern(layer)), _path(table.intern(path)), _fieldName(table.intern(fieldName)),
+          _newValue(std::move(newValue)), _previousValue(std::move(previousValue)) {}
 
     UndoRedoSetField(UndoRedoSetField &&) noexcept = default;
     ~UndoRedoSetField() = default;
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetField(_path, _fieldName, _newValue);
+    void do_it(const InternTable &table) { _set(table, false); }
+
+    void undo_it(const InternTable &table) { _set(table, true); }
+
+    /// Keep only the changed elements when both values are large arrays of the same size
+    void compact() {
+        if (delta()) {
+            return;
         }
+        if (std::shared_ptr<const ArrayDelta> changes = ArrayDelta::make(_previousValue, _newValue)) {
+            _newValue = VtValue();
+            _previousValue = VtValue(std::move(changes));
+        }
+    }
+
+    [[nodiscard]] const ArrayDelta *delta() const { return compacted_delta(_previousValue); }
+
+    [[nodiscard]] size_t footprint() const {
+        const ArrayDelta *changes = delta();
+        return sizeof(*this) + vt_value_footprint(_newValue) + vt_value_footprint(_previousValue) +
+               (changes ? changes->footprint() : 0);
     }
 
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetField(_path, _fieldName, _previousValue);
+    void _set(const InternTable &table, bool undo) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            const SdfPath &path = table.path(_path);
+            const TfToken &fieldName = table.token(_fieldName);
+            const ArrayDelta *changes = delta();
+            if (!changes) {
+                layer->GetStateDelegate()->SetField(path, fieldName, undo ? _previousValue : _newValue);
+            } else if (VtValue value; changes->apply(layer->GetField(path, fieldName), undo, value)) {
+                layer->GetStateDelegate()->SetField(path, fieldName, value);
+            }
         }
     }
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _path;
-    const TfToken _fieldName;
+    const InternTable::Index _layer;
+    const InternTable::Index _path;
+    const InternTable::Index _fieldName;
     VtValue _newValue;
+    /// Holds the ArrayDelta of both values once compacted
     VtValue _previousValue;
 };
 
 struct UndoRedoSetFieldDictValueByKey {
-    UndoRedoSetFieldDictValueByKey(const SdfLayerHandle &layer, SdfPath path,
-                                   TfToken fieldName, TfToken keyPath,
+    UndoRedoSetFieldDictValueByKey(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path,
+                                   const TfToken &fieldName, const TfToken &keyPath,
                                    VtValue value, VtValue previousValue)
-        : _layer(layer), _path(std::move(path)), _fieldName(std::move(fieldName)),
-          _keyPath(std::move(keyPath)), _newValue(std::move(value)),
+        : _layer(table.intern(layer)), _path(table.intern(path)), _fieldName(table.intern(fieldName)),
+          _keyPath(table.intern(keyPath)), _newValue(std::move(value)),
           _previousValue(std::move(previousValue)) {}
 
     UndoRedoSetFieldDictValueByKey(UndoRedoSetFieldDictValueByKey &&) noexcept = default;
     ~UndoRedoSetFieldDictValueByKey() = default;
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _newValue);
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->SetFieldDictValueByKey(table.path(_path), table.token(_fieldName),
+                                                              table.token(_keyPath), _newValue);
         }
     }
 
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _previousValue);
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->SetFieldDictValueByKey(table.path(_path), table.token(_fieldName),
+                                                              table.token(_keyPath), _previousValue);
         }
     }
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _path;
-    const TfToken _fieldName;
-    const TfToken _keyPath;
+    [[nodiscard]] size_t footprint() const {
+        return sizeof(*this) + vt_value_footprint(_newValue) + vt_value_footprint(_previousValue);
+    }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _path;
+    const InternTable::Index _fieldName;
+    const InternTable::Index _keyPath;
     VtValue _newValue;
     VtValue _previousValue;
 };
 
 struct UndoRedoSetTimeSample {
-    UndoRedoSetTimeSample(const SdfLayerHandle &layer, const SdfPath &path, double timeCode, VtValue newValue)
-        : _layer(layer), _path(path), _timeCode(timeCode), _newValue(std::move(newValue)), _isKeyFrame(false),
-          _hasTimeSamples(false) {
+    UndoRedoSetTimeSample(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, double timeCode,
+                          VtValue newValue)
+        : _layer(table.intern(layer)), _path(table.intern(path)), _timeCode(timeCode), _newValue(std::move(newValue)),
+          _isKeyFrame(false), _hasTimeSamples(false) {
 
-        if (_layer && _layer->HasField(path, SdfFieldKeys->TimeSamples)) {
+        if (layer && layer->HasField(path, SdfFieldKeys->TimeSamples)) {
             _hasTimeSamples = true;
-            _isKeyFrame = _layer->QueryTimeSample(_path, _timeCode, &_previousValue);
+            _isKeyFrame = layer->QueryTimeSample(path, _timeCode, &_previousValue);
         }
     }
+
+    /// Restore a sample already recorded, without looking at the layer
+    UndoRedoSetTimeSample(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, double timeCode,
+                          VtValue newValue, VtValue previousValue, bool isKeyFrame, bool hasTimeSamples)
+        : _layer(table.intern(layer)), _path(table.intern(path)), _timeCode(timeCode), _newValue(std::move(newValue)),
+          _previousValue(std::move(previousValue)), _isKeyFrame(isKeyFrame), _hasTimeSamples(hasTimeSamples) {}
+
     ~UndoRedoSetTimeSample() = default;
     UndoRedoSetTimeSample(UndoRedoSetTimeSample &&) noexcept = default;
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _newValue);
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            const SdfPath &path = table.path(_path);
+            if (!delta()) {
+                layer->GetStateDelegate()->SetTimeSample(path, _timeCode, _newValue);
+            } else {
+                _set_patched(layer, path, false);
+            }
         }
     }
 
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            if (_hasTimeSamples && _isKeyFrame) {
-                _layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _previousValue);
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            const SdfPath &path = table.path(_path);
+            if (_hasTimeSamples && _isKeyFrame && delta()) {
+                _set_patched(layer, path, true);
+            } else if (_hasTimeSamples && _isKeyFrame) {
+                layer->GetStateDelegate()->SetTimeSample(path, _timeCode, _previousValue);
             } else if (_hasTimeSamples && !_isKeyFrame) {
-                _layer->EraseTimeSample(_path, _timeCode);
+                layer->EraseTimeSample(path, _timeCode);
             } else if (!_hasTimeSamples) {
-                _layer->GetStateDelegate()->SetField(_path, SdfFieldKeys->TimeSamples, _previousValue);
+                layer->GetStateDelegate()->SetField(path, SdfFieldKeys->TimeSamples, _previousValue);
             } else {
                 // This shouldn't happen
             }
         }
     }
 
-    // TODO: look for reducing the size of this struct
-    SdfLayerRefPtr _layer;
-    const SdfPath _path;
+    /// Keep only the changed elements when the sample replaced a previous sample of the same array size
+    void compact() {
+        if (delta() || !_hasTimeSamples || !_isKeyFrame) {
+            return;
+        }
+        if (std::shared_ptr<const ArrayDelta> changes = ArrayDelta::make(_previousValue, _newValue)) {
+            _newValue = VtValue();
+            _previousValue = VtValue(std::move(changes));
+        }
+    }
+
+    [[nodiscard]] const ArrayDelta *delta() const { return compacted_delta(_previousValue); }
+
+    [[nodiscard]] size_t footprint() const {
+        const ArrayDelta *changes = delta();
+        return sizeof(*this) + vt_value_footprint(_newValue) + vt_value_footprint(_previousValue) +
+               (changes ? changes->footprint() : 0);
+    }
+
+    void _set_patched(const SdfLayerRefPtr &layer, const SdfPath &path, bool undo) {
+        VtValue current, value;
+        if (layer->QueryTimeSample(path, _timeCode, &current) && delta()->apply(current, undo, value)) {
+            layer->GetStateDelegate()->SetTimeSample(path, _timeCode, value);
+        }
+    }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _path;
     double _timeCode;
     VtValue _newValue;
+    /// Holds the ArrayDelta of both values once compacted
     VtValue _previousValue;
     bool _isKeyFrame;
     bool _hasTimeSamples;
 };
 
 struct UndoRedoCreateSpec {
-    UndoRedoCreateSpec(const SdfLayerHandle &layer, SdfPath path, SdfSpecType specType, bool inert)
-        : _layer(layer), _path(std::move(path)), _specType(specType), _inert(inert) {}
-
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->CreateSpec(_path, _specType, _inert);
+    UndoRedoCreateSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, SdfSpecType specType,
+                       bool inert)
+        : _layer(table.intern(layer)), _path(table.intern(path)), _specType(specType), _inert(inert) {}
+
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->CreateSpec(table.path(_path), _specType, _inert);
         }
     }
 
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->DeleteSpec(_path, _inert);
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->DeleteSpec(table.path(_path), _inert);
         }
     }
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _path;
+    [[nodiscard]] size_t footprint() const { return sizeof(*this); }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _path;
     const SdfSpecType _specType;
     const bool _inert;
 };
@@ -148,84 +251,112 @@ struct UndoRedoDeleteSpec {
         SdfAbstractData *const dst;
     };
 
-    UndoRedoDeleteSpec(const SdfLayerHandle &layer, const SdfPath &path, bool inert, SdfAbstractDataPtr layerData);
+    UndoRedoDeleteSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, bool inert,
+                       SdfAbstractDataPtr layerData);
+
+    /// A deletion read back from a journal. The layer data is not known then, the undo goes through the state
+    /// delegate of the layer.
+    UndoRedoDeleteSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &path, bool inert,
+                       SdfSpecType deletedSpecType, SdfDataRefPtr deletedData);
 
-    void do_it();
-    void undo_it();
+    void do_it(const InternTable &table);
+    void undo_it(const InternTable &table);
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _path;
+    [[nodiscard]] size_t footprint() const { return sizeof(*this) + _deletedFootprint; }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _path;
     const bool _inert;
 
     SdfAbstractDataPtr _layerData;// TODO: this might change ? isn't it ? normally it's retrieved from the delegate
     const SdfSpecType _deletedSpecType;
     SdfDataRefPtr _deletedData;
+    /// estimated size of _deletedData, computed once it is copied
+    size_t _deletedFootprint = 0;
 };
 
 struct UndoRedoMoveSpec {
-    UndoRedoMoveSpec(const SdfLayerHandle &layer, SdfPath oldPath, SdfPath newPath)
-        : _layer(layer), _oldPath(std::move(oldPath)), _newPath(std::move(newPath)) {}
+    UndoRedoMoveSpec(InternTable &table, const SdfLayerHandle &layer, const SdfPath &oldPath, const SdfPath &newPath)
+        : _layer(table.intern(layer)), _oldPath(table.intern(oldPath)), _newPath(table.intern(newPath)) {}
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->MoveSpec(_oldPath, _newPath);
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->MoveSpec(table.path(_oldPath), table.path(_newPath));
         }
     };
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->MoveSpec(_newPath, _oldPath);
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->MoveSpec(table.path(_newPath), table.path(_oldPath));
         }
     };
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _oldPath;
-    const SdfPath _newPath;
+    [[nodiscard]] size_t footprint() const { return sizeof(*this); }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _oldPath;
+    const InternTable::Index _newPath;
 };
 
 template<typename ValueT>
 struct UndoRedoPushChild {
-    UndoRedoPushChild(const SdfLayerHandle &layer, SdfPath parentPath, TfToken fieldName, const ValueT &value)
-        : _layer(layer), _parentPath(std::move(parentPath)), _fieldName(std::move(fieldName)), _value(value) {}
-
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
+    UndoRedoPushChild(InternTable &table, const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName,
+                      const ValueT &value)
+        : _layer(table.intern(layer)), _parentPath(table.intern(parentPath)), _fieldName(table.intern(fieldName)),
+          _value(table.intern(value)) {}
+
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PopChild(table.path(_parentPath), table.token(_fieldName), table.get<ValueT>(_value));
         }
     }
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PushChild(table.path(_parentPath), table.token(_fieldName), table.get<ValueT>(_value));
         }
     }
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _parentPath;
-    const TfToken _fieldName;
-    const ValueT _value;
+    [[nodiscard]] size_t footprint() const { return sizeof(*this); }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _parentPath;
+    const InternTable::Index _fieldName;
+    /// index of the path or token pushed or popped
+    const InternTable::Index _value;
 };
 
 template<typename ValueT>
 struct UndoRedoPopChild {
-    UndoRedoPopChild(const SdfLayerHandle &layer, SdfPath parentPath, TfToken fieldName, const ValueT &value)
-        : _layer(layer), _parentPath(std::move(parentPath)), _fieldName(std::move(fieldName)), _value(value) {}
-
-    void undo_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
+    UndoRedoPopChild(InternTable &table, const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName,
+                     const ValueT &value)
+        : _layer(table.intern(layer)), _parentPath(table.intern(parentPath)), _fieldName(table.intern(fieldName)),
+          _value(table.intern(value)) {}
+
+    void undo_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PushChild(table.path(_parentPath), table.token(_fieldName), table.get<ValueT>(_value));
         }
     }
 
-    void do_it() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
+    void do_it(const InternTable &table) {
+        const auto &layer = table.layer(_layer);
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PopChild(table.path(_parentPath), table.token(_fieldName), table.get<ValueT>(_value));
         }
     }
 
-    SdfLayerRefPtr _layer;
-    const SdfPath _parentPath;
-    const TfToken _fieldName;
-    const ValueT _value;
+    [[nodiscard]] size_t footprint() const { return sizeof(*this); }
+
+    const InternTable::Index _layer;
+    const InternTable::Index _parentPath;
+    const InternTable::Index _fieldName;
+    /// index of the path or token pushed or popped
+    const InternTable::Index _value;
 };
 
 }// namespace vox
\ No newline at end of file
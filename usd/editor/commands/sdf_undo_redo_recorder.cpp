@@ -32,6 +32,9 @@ void SdfUndoRedoRecorder::stop_recording() {
     if (_layer && _previousDelegate) {
         _layer->SetStateDelegate(_previousDelegate);
     }
+    if (_editedCommand) {
+        _editedCommand->_undoCommands.end_recording();
+    }
 }
 
 }// namespace vox
\ No newline at end of file
@@ -0,0 +1,418 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "session_journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <signal.h>
+#include <unistd.h>
+#include <pxr/pxr.h>
+#include "sdf_command_serializer.h"
+
+namespace vox {
+namespace {
+constexpr const char *kJournalPrefix = "session_journal_";
+constexpr const char *kJournalSuffix = ".bin";
+
+// The file starts with the magic, the format version and the build which wrote it. The events are in the native
+// layout and refer to the instruction types and Sdf enums by value, only the same build can read them back.
+constexpr char kJournalMagic[8] = {'V', 'O', 'X', 'J', 'R', 'N', 'L', '\0'};
+// Bumped when the encoding of the events or of the instructions changes
+constexpr uint32_t kJournalFormatVersion = 2;
+
+const std::string &_build_id() {
+    static const std::string id = std::string(__DATE__ " " __TIME__ " usd ") + std::to_string(PXR_VERSION);
+    return id;
+}
+
+// Events are written as [type][payload size][payload], a crash while writing leaves a truncated event
+// which is ignored
+enum EventType : uint8_t {
+    Push,
+    Lost,
+    Undo,
+    Redo,
+    Clear,
+};
+
+/// Last modification of the layer file. An edit is replayed only if its layer file didn't change since.
+int64_t _layer_stamp(const SdfLayerHandle &layer) {
+    if (!layer || layer->IsAnonymous()) {
+        return -1;
+    }
+    std::error_code error;
+    const auto time = std::filesystem::last_write_time(layer->GetRealPath(), error);
+    return error ? -1 : int64_t(time.time_since_epoch().count());
+}
+
+struct _ReplayEntry {
+    std::vector<SdfLayerRefPtr> layers;
+    /// The identifiers of the layers, unknown for the entries which are not made of instructions
+    std::vector<std::string> identifiers;
+    bool known = true;
+    std::vector<std::span<const char>> groups;
+    bool lost = true;
+};
+
+/// The layers on which an edit was lost or failed to apply. Their later edits may depend on it, they are skipped
+/// too.
+struct _DroppedLayers {
+    std::set<std::string> identifiers;
+    bool all = false;
+
+    [[nodiscard]] bool contains(const _ReplayEntry &entry) const {
+        return all || !entry.known || std::any_of(entry.identifiers.begin(), entry.identifiers.end(),
+                                                  [this](const std::string &id) { return identifiers.count(id) > 0; });
+    }
+
+    void add(const _ReplayEntry &entry) {
+        all = all || !entry.known;
+        identifiers.insert(entry.identifiers.begin(), entry.identifiers.end());
+    }
+};
+
+bool _read_identifiers(BinaryReader &reader, std::vector<std::string> &identifiers) {
+    uint32_t count = 0;
+    if (!reader.read_pod(count) || count > reader.remaining() / sizeof(uint64_t)) {
+        return false;
+    }
+    identifiers.resize(count);
+    for (auto &identifier : identifiers) {
+        if (!reader.read_string(identifier)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool _read_stamps(BinaryReader &reader, std::vector<int64_t> &stamps) {
+    uint32_t count = 0;
+    if (!reader.read_pod(count) || count > reader.remaining() / sizeof(int64_t)) {
+        return false;
+    }
+    stamps.resize(count);
+    for (auto &stamp : stamps) {
+        if (!reader.read_pod(stamp)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// The layers are all there and none of them changed on disk since the stamps were taken
+bool _is_current(const std::vector<SdfLayerRefPtr> &layers, const std::vector<int64_t> &stamps) {
+    if (layers.size() != stamps.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < layers.size(); ++i) {
+        if (!layers[i] || stamps[i] < 0 || _layer_stamp(layers[i]) != stamps[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool _apply(const _ReplayEntry &entry, bool undo) {
+    std::vector<SdfCommandGroup> groups(entry.groups.size());
+    for (size_t i = 0; i < entry.groups.size(); ++i) {
+        if (!deserialize_command_group(entry.groups[i], entry.layers, groups[i])) {
+            return false;
+        }
+    }
+    if (undo) {
+        for (auto group = groups.rbegin(); group != groups.rend(); ++group) {
+            group->undo_it();
+        }
+    } else {
+        for (auto &group : groups) {
+            group.do_it();
+        }
+    }
+    return true;
+}
+}// namespace
+
+SessionJournal::SessionJournal()
+    : _filename((std::filesystem::temp_directory_path() / (kJournalPrefix + std::to_string(getpid()) + kJournalSuffix))
+                    .string()) {
+    _file.open(_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        std::cerr << "Unable to open the session journal " << _filename << std::endl;
+        return;
+    }
+    std::vector<char> header;
+    BinaryWriter writer(header);
+    writer.write_bytes(kJournalMagic, sizeof(kJournalMagic));
+    writer.write_pod(kJournalFormatVersion);
+    writer.write_string(_build_id());
+    _file.write(header.data(), std::streamsize(header.size()));
+    _file.flush();
+}
+
+SessionJournal::~SessionJournal() {
+    if (_file.is_open()) {
+        _file.close();
+        std::remove(_filename.c_str());
+    }
+}
+
+void SessionJournal::_write_event(uint8_t type, const std::vector<char> &payload) {
+    if (!_file.is_open()) {
+        return;
+    }
+    _file.put(char(type));
+    const auto size = uint64_t(payload.size());
+    _file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    _file.write(payload.data(), std::streamsize(payload.size()));
+    // the event must be on disk before the next frame, a crash can happen anytime
+    _file.flush();
+}
+
+void SessionJournal::_write_stamps(uint8_t type, const std::vector<SdfLayerHandle> &layers) {
+    std::vector<char> payload;
+    BinaryWriter writer(payload);
+    writer.write_pod(uint32_t(layers.size()));
+    for (const auto &layer : layers) {
+        writer.write_pod(_layer_stamp(layer));
+    }
+    _write_event(type, payload);
+}
+
+void SessionJournal::write_push(const std::vector<const SdfCommandGroup *> &groups) {
+    std::vector<SdfLayerRefPtr> layers;
+    std::vector<std::vector<char>> encoded(groups.size());
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (!serialize_command_group(*groups[i], layers, encoded[i])) {
+            std::vector<SdfLayerHandle> edited;
+            for (const auto *group : groups) {
+                for (const SdfLayerHandle layer : group->layers()) {
+                    if (std::find(edited.begin(), edited.end(), layer) == edited.end()) {
+                        edited.push_back(layer);
+                    }
+                }
+            }
+            _write_lost(edited, true);
+            return;
+        }
+    }
+
+    std::vector<char> payload;
+    BinaryWriter writer(payload);
+    writer.write_pod(uint32_t(layers.size()));
+    for (const auto &layer : layers) {
+        writer.write_string(layer ? layer->GetIdentifier() : std::string());
+        writer.write_pod(_layer_stamp(layer));
+    }
+    writer.write_pod(uint32_t(encoded.size()));
+    for (const auto &group : encoded) {
+        writer.write_pod(uint64_t(group.size()));
+        writer.write_bytes(group.data(), group.size());
+    }
+    _write_event(Push, payload);
+
+    _entryLayers.resize(_position);
+    _entryLayers.emplace_back(layers.begin(), layers.end());
+    _position++;
+}
+
+void SessionJournal::write_lost() { _write_lost({}, false); }
+
+void SessionJournal::_write_lost(const std::vector<SdfLayerHandle> &layers, bool known) {
+    std::vector<char> payload;
+    BinaryWriter writer(payload);
+    writer.write_pod(known);
+    writer.write_pod(uint32_t(layers.size()));
+    for (const auto &layer : layers) {
+        writer.write_string(layer ? layer->GetIdentifier() : std::string());
+    }
+    _write_event(Lost, payload);
+    _entryLayers.resize(_position);
+    _entryLayers.push_back(layers);
+    _position++;
+}
+
+void SessionJournal::write_undo() {
+    if (_position > 0) {
+        _position--;
+        _write_stamps(Undo, _entryLayers[_position]);
+    }
+}
+
+void SessionJournal::write_redo() {
+    if (_position < _entryLayers.size()) {
+        _write_stamps(Redo, _entryLayers[_position]);
+        _position++;
+    }
+}
+
+void SessionJournal::write_clear() {
+    _write_event(Clear, {});
+    _entryLayers.clear();
+    _position = 0;
+}
+
+std::vector<std::string> SessionJournal::find_orphans() {
+    std::vector<std::string> orphans;
+    const std::string prefix(kJournalPrefix);
+    const std::string suffix(kJournalSuffix);
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(std::filesystem::temp_directory_path(error), error)) {
+        const std::string name = file.path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        const auto pid = pid_t(std::atol(name.substr(prefix.size(), name.size() - prefix.size() - suffix.size()).c_str()));
+        // the journal of a running editor is not an orphan
+        if (pid > 0 && pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH) {
+            orphans.push_back(file.path().string());
+        }
+    }
+    return orphans;
+}
+
+std::vector<SdfLayerRefPtr> SessionJournal::replay(const std::string &filename, std::string &report) {
+    std::vector<char> data;
+    {
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    BinaryReader events(data);
+    char magic[sizeof(kJournalMagic)] = {};
+    uint32_t version = 0;
+    std::string buildId;
+    if (!events.read_bytes(magic, sizeof(magic)) || std::memcmp(magic, kJournalMagic, sizeof(magic)) != 0 ||
+        !events.read_pod(version) || version != kJournalFormatVersion || !events.read_string(buildId) ||
+        buildId != _build_id()) {
+        // the journal is kept, it can still be replayed by the build which wrote it
+        report = "Session journal " + filename + " was not written by this build of the editor (" +
+                 (buildId.empty() ? std::string("unknown build") : buildId) + "), nothing was replayed. " +
+                 "Replay it with that build, or discard it.";
+        return {};
+    }
+
+    std::vector<_ReplayEntry> entries;
+    size_t position = 0;
+    size_t replayed = 0, skipped = 0, lost = 0;
+    std::vector<SdfLayerRefPtr> editedLayers;
+    _DroppedLayers dropped;
+
+    while (!events.at_end()) {
+        uint8_t type = 0;
+        uint64_t size = 0;
+        if (!events.read_pod(type) || !events.read_pod(size) || size > events.remaining()) {
+            break;
+        }
+        BinaryReader reader(events.read_span(size));
+
+        if (type == Push || type == Lost) {
+            entries.resize(position);
+            auto &entry = entries.emplace_back();
+            position++;
+            if (type == Lost) {
+                // a lost entry with an unreadable payload may have edited any layer
+                bool known = false;
+                entry.known = reader.read_pod(known) && known && _read_identifiers(reader, entry.identifiers);
+                lost++;
+                dropped.add(entry);
+                continue;
+            }
+            // the groups point into data, they are decoded when applied
+            uint32_t layerCount = 0;
+            std::vector<int64_t> stamps;
+            bool valid = reader.read_pod(layerCount);
+            for (uint32_t i = 0; valid && i < layerCount; ++i) {
+                std::string identifier;
+                int64_t stamp = -1;
+                valid = reader.read_string(identifier) && reader.read_pod(stamp);
+                entry.layers.push_back(identifier.empty() ? SdfLayerRefPtr() : SdfLayer::FindOrOpen(identifier));
+                entry.identifiers.push_back(identifier);
+                stamps.push_back(stamp);
+            }
+            uint32_t groupCount = 0;
+            valid = valid && reader.read_pod(groupCount);
+            for (uint32_t i = 0; valid && i < groupCount; ++i) {
+                uint64_t groupSize = 0;
+                valid = reader.read_pod(groupSize) && groupSize > 0 && groupSize <= reader.remaining();
+                if (valid) {
+                    entry.groups.push_back(reader.read_span(groupSize));
+                }
+            }
+            entry.lost = !valid;
+            entry.known = valid;
+            if (entry.lost) {
+                lost++;
+                dropped.add(entry);
+            } else if (dropped.contains(entry)) {
+                skipped++;
+                dropped.add(entry);
+            } else if (!_is_current(entry.layers, stamps)) {
+                // the edit was saved, or the file changed since, the later edits don't depend on it
+                skipped++;
+            } else if (_apply(entry, false)) {
+                replayed++;
+                std::copy_if(entry.layers.begin(), entry.layers.end(), std::back_inserter(editedLayers),
+                             [&editedLayers](const SdfLayerRefPtr &layer) {
+                                 return std::find(editedLayers.begin(), editedLayers.end(), layer) == editedLayers.end();
+                             });
+            } else {
+                skipped++;
+                dropped.add(entry);
+            }
+        } else if (type == Undo || type == Redo) {
+            const bool undo = type == Undo;
+            if ((undo && position == 0) || (!undo && position >= entries.size())) {
+                continue;
+            }
+            const auto &entry = undo ? entries[--position] : entries[position++];
+            std::vector<int64_t> stamps;
+            if (entry.lost) {
+                continue;
+            }
+            if (dropped.contains(entry)) {
+                skipped++;
+                dropped.add(entry);
+            } else if (!_read_stamps(reader, stamps) || !_is_current(entry.layers, stamps)) {
+                skipped++;
+            } else if (_apply(entry, undo)) {
+                replayed++;
+            } else {
+                skipped++;
+                dropped.add(entry);
+            }
+        } else if (type == Clear) {
+            entries.clear();
+            position = 0;
+        }
+    }
+
+    report = "Session journal " + filename + ": " + std::to_string(replayed) + " edits replayed, " +
+             std::to_string(skipped) + " skipped, " + std::to_string(lost) + " lost";
+    if (dropped.all) {
+        report += "\nAn edit which is not recorded as instructions was lost, the edits after it were dropped";
+    } else if (!dropped.identifiers.empty()) {
+        report += "\nThe edits of these layers were dropped from the first one which could not be replayed:";
+        for (const auto &identifier : dropped.identifiers) {
+            report += "\n  " + (identifier.empty() ? std::string("<unknown layer>") : identifier);
+        }
+    }
+    discard(filename);
+    return editedLayers;
+}
+
+void SessionJournal::discard(const std::string &filename) {
+    std::remove(filename.c_str());
+}
+
+}// namespace vox
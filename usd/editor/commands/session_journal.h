@@ -0,0 +1,68 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <pxr/usd/sdf/layer.h>
+#include "sdf_command_group.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace vox {
+/// Write-ahead log of the edits of an editor session, used to recover them after a crash.
+/// The instructions of every undo entry pushed are appended, as well as the undo, redo and clear of the stack,
+/// so that the layers can be brought back to their state at the time of the crash. The file lives in the temp
+/// directory and is removed when the session ends normally. It starts with a header naming the build which wrote
+/// it, another build refuses to replay it.
+class SessionJournal {
+public:
+    SessionJournal();
+    ~SessionJournal();
+
+    SessionJournal(const SessionJournal &) = delete;
+    SessionJournal &operator=(const SessionJournal &) = delete;
+
+    [[nodiscard]] bool is_open() const { return _file.is_open(); }
+
+    /// A new undo entry made of the instructions of groups. When one of them can't be encoded the entry is
+    /// written as lost with the layers it edited, it keeps its place in the stack but is not replayed.
+    void write_push(const std::vector<const SdfCommandGroup *> &groups);
+    /// An entry which is not made of instructions, the layers it edited are not known
+    void write_lost();
+    void write_undo();
+    void write_redo();
+    void write_clear();
+
+    /// The journals of the sessions which did not end normally
+    static std::vector<std::string> find_orphans();
+
+    /// Apply the edits of a journal onto their layers and remove it. The edits of layers which can't be opened,
+    /// or which were saved or modified on disk after the edit, are skipped. Once an edit is lost or skipped, the
+    /// later edits of its layers are skipped as well since they may depend on it, and the report lists these
+    /// layers. A journal written by another build is not replayed and left in place, the report says why.
+    /// Returns the layers edited.
+    static std::vector<SdfLayerRefPtr> replay(const std::string &filename, std::string &report);
+
+    static void discard(const std::string &filename);
+
+private:
+    void _write_event(uint8_t type, const std::vector<char> &payload);
+    void _write_stamps(uint8_t type, const std::vector<SdfLayerHandle> &layers);
+    void _write_lost(const std::vector<SdfLayerHandle> &layers, bool known);
+
+    std::string _filename;
+    std::ofstream _file;
+
+    /// The layers of the entries and the position in the stack, mirroring the command stack to stamp undo and redo
+    std::vector<std::vector<SdfLayerHandle>> _entryLayers;
+    size_t _position = 0;
+};
+
+}// namespace vox
@@ -0,0 +1,71 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "undo_journal.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <unistd.h>
+
+namespace vox {
+namespace {
+constexpr auto kJournalMode = std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc;
+}// namespace
+
+UndoJournal::UndoJournal()
+    : _filename((std::filesystem::temp_directory_path() / ("undo_journal_" + std::to_string(getpid()) + ".bin")).string()) {
+    _file.open(_filename, kJournalMode);
+    if (!_file.is_open()) {
+        std::cerr << "Unable to open the undo journal " << _filename << std::endl;
+    }
+}
+
+UndoJournal::~UndoJournal() {
+    if (_file.is_open()) {
+        _file.close();
+        std::remove(_filename.c_str());
+    }
+}
+
+std::optional<UndoJournal::Record> UndoJournal::append(std::span<const char> data) {
+    if (!_file.is_open()) {
+        return std::nullopt;
+    }
+    _file.clear();
+    _file.seekp(std::streamoff(_size));
+    _file.write(data.data(), std::streamsize(data.size()));
+    if (!_file) {
+        std::cerr << "Unable to write to the undo journal " << _filename << std::endl;
+        return std::nullopt;
+    }
+    Record record{_size, data.size()};
+    _size += data.size();
+    return record;
+}
+
+bool UndoJournal::read(const Record &record, std::vector<char> &data) {
+    if (!_file.is_open() || record.offset + record.size > _size) {
+        return false;
+    }
+    // pending appends must reach the file before reading it back
+    _file.flush();
+    _file.clear();
+    _file.seekg(std::streamoff(record.offset));
+    data.resize(record.size);
+    _file.read(data.data(), std::streamsize(record.size));
+    return bool(_file);
+}
+
+void UndoJournal::reset() {
+    if (_file.is_open()) {
+        _file.close();
+        _file.open(_filename, kJournalMode);
+    }
+    _size = 0;
+}
+
+}// namespace vox
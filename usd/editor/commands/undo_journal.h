@@ -0,0 +1,50 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace vox {
+/// Append only file holding the undo entries written out of memory. It lives in the temp directory and is
+/// removed with the journal. Entries are never rewritten, the space of dropped entries is only given back on reset.
+class UndoJournal {
+public:
+    /// Where an entry was written
+    struct Record {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    UndoJournal();
+    ~UndoJournal();
+
+    UndoJournal(const UndoJournal &) = delete;
+    UndoJournal &operator=(const UndoJournal &) = delete;
+
+    [[nodiscard]] bool is_open() const { return _file.is_open(); }
+
+    /// Size of the file
+    [[nodiscard]] uint64_t size() const { return _size; }
+
+    std::optional<Record> append(std::span<const char> data);
+    bool read(const Record &record, std::vector<char> &data);
+
+    /// Truncate the file, the records already given are invalid afterward
+    void reset();
+
+private:
+    std::string _filename;
+    std::fstream _file;
+    uint64_t _size = 0;
+};
+
+}// namespace vox
@@ -86,7 +86,7 @@ void UndoRedoLayerStateDelegate::_OnSetField(
     set_dirty();
     const VtValue previousValue = _layer->GetField(path, fieldName);
     const VtValue &newValue = value;
-    _undoCommands.store_instruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    _undoCommands.emplace_instruction<UndoRedoSetField>(_layer, path, fieldName, newValue, previousValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnSetField(
@@ -97,7 +97,7 @@ void UndoRedoLayerStateDelegate::_OnSetField(
     const VtValue previousValue = _layer->GetField(path, fieldName);
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.store_instruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    _undoCommands.emplace_instruction<UndoRedoSetField>(_layer, path, fieldName, newValue, previousValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
@@ -108,7 +108,7 @@ void UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
     set_dirty();
     const VtValue previousValue = _layer->GetFieldDictValueByKey(path, fieldName, keyPath);// TODO should the instruction retrieve the value instead ?
     const VtValue &newValue = value;
-    _undoCommands.store_instruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    _undoCommands.emplace_instruction<UndoRedoSetFieldDictValueByKey>(_layer, path, fieldName, keyPath, newValue, previousValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
@@ -121,7 +121,7 @@ void UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
 
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.store_instruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    _undoCommands.emplace_instruction<UndoRedoSetFieldDictValueByKey>(_layer, path, fieldName, keyPath, newValue, previousValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnSetTimeSample(
@@ -129,7 +129,7 @@ void UndoRedoLayerStateDelegate::_OnSetTimeSample(
     double timeCode,
     const VtValue &value) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoSetTimeSample>({_layer, path, timeCode, value});
+    _undoCommands.emplace_instruction<UndoRedoSetTimeSample>(_layer, path, timeCode, value);
 }
 
 void UndoRedoLayerStateDelegate::_OnSetTimeSample(
@@ -140,7 +140,7 @@ void UndoRedoLayerStateDelegate::_OnSetTimeSample(
     VtValue newValue;
     value.GetValue(&newValue);
 
-    _undoCommands.store_instruction<UndoRedoSetTimeSample>({_layer, path, timeCode, newValue});
+    _undoCommands.emplace_instruction<UndoRedoSetTimeSample>(_layer, path, timeCode, newValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnCreateSpec(
@@ -148,7 +148,7 @@ void UndoRedoLayerStateDelegate::_OnCreateSpec(
     SdfSpecType specType,
     bool inert) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoCreateSpec>({_layer, path, specType, inert});
+    _undoCommands.emplace_instruction<UndoRedoCreateSpec>(_layer, path, specType, inert);
 }
 
 void UndoRedoLayerStateDelegate::_OnDeleteSpec(
@@ -156,14 +156,14 @@ void UndoRedoLayerStateDelegate::_OnDeleteSpec(
     bool inert) {
     set_dirty();
 
-    _undoCommands.store_instruction<UndoRedoDeleteSpec>({_layer, path, inert, _GetLayerData()});
+    _undoCommands.emplace_instruction<UndoRedoDeleteSpec>(_layer, path, inert, _GetLayerData());
 }
 
 void UndoRedoLayerStateDelegate::_OnMoveSpec(
     const SdfPath &oldPath,
     const SdfPath &newPath) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoMoveSpec>({_layer, oldPath, newPath});
+    _undoCommands.emplace_instruction<UndoRedoMoveSpec>(_layer, oldPath, newPath);
 }
 
 void UndoRedoLayerStateDelegate::_OnPushChild(
@@ -171,7 +171,7 @@ void UndoRedoLayerStateDelegate::_OnPushChild(
     const TfToken &fieldName,
     const TfToken &value) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoPushChild<TfToken>>({_layer, parentPath, fieldName, value});
+    _undoCommands.emplace_instruction<UndoRedoPushChild<TfToken>>(_layer, parentPath, fieldName, value);
 }
 
 void UndoRedoLayerStateDelegate::_OnPushChild(
@@ -179,7 +179,7 @@ void UndoRedoLayerStateDelegate::_OnPushChild(
     const TfToken &fieldName,
     const SdfPath &value) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoPushChild<SdfPath>>({_layer, parentPath, fieldName, value});
+    _undoCommands.emplace_instruction<UndoRedoPushChild<SdfPath>>(_layer, parentPath, fieldName, value);
 }
 
 void UndoRedoLayerStateDelegate::_OnPopChild(
@@ -187,7 +187,7 @@ void UndoRedoLayerStateDelegate::_OnPopChild(
     const TfToken &fieldName,
     const TfToken &oldValue) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoPopChild<TfToken>>({_layer, parentPath, fieldName, oldValue});
+    _undoCommands.emplace_instruction<UndoRedoPopChild<TfToken>>(_layer, parentPath, fieldName, oldValue);
 }
 
 void UndoRedoLayerStateDelegate::_OnPopChild(
@@ -195,7 +195,7 @@ void UndoRedoLayerStateDelegate::_OnPopChild(
     const TfToken &fieldName,
     const SdfPath &oldValue) {
     set_dirty();
-    _undoCommands.store_instruction<UndoRedoPopChild<SdfPath>>({_layer, parentPath, fieldName, oldValue});
+    _undoCommands.emplace_instruction<UndoRedoPopChild<SdfPath>>(_layer, parentPath, fieldName, oldValue);
 }
 
 }// namespace vox
\ No newline at end of file
@@ -24,6 +24,7 @@
 #include "widgets/sdf_prim_editor.h"
 #include "base/constants.h"
 #include "commands/commands.h"
+#include "commands/command_stack.h"
 #include "fonts/resources_loader.h"
 #include "widgets/sdf_attribute_editor.h"
 #include "widgets/text_editor.h"
@@ -40,6 +41,7 @@
 #include <imgui_internal.h>
 #include <imgui_stdlib.h>
 
+#include <iostream>
 #include <utility>
 
 namespace vox {
@@ -136,6 +138,48 @@ struct CloseEditorModalDialog : public ModalDialog {
     std::string confirmReasons;
 };
 
+/// Offered at startup when the journal of a session which crashed is found
+struct RecoverSessionModalDialog : public ModalDialog {
+    RecoverSessionModalDialog(Editor &editor, std::vector<std::string> journals) : editor(editor), journals(std::move(journals)) {}
+
+    void draw() override {
+        // once replayed, the dialog shows what was recovered and what was dropped
+        if (!reports.empty()) {
+            for (const auto &report : reports) {
+                ImGui::TextUnformatted(report.c_str());
+            }
+            if (ImGui::Button("  Ok  ")) {
+                close_modal();
+            }
+            return;
+        }
+        ImGui::Text("A previous session did not exit properly.");
+        ImGui::Text("Replay its unsaved edits onto the layers ?");
+        if (ImGui::Button("  Discard  ")) {
+            for (const auto &journal : journals) {
+                SessionJournal::discard(journal);
+            }
+            close_modal();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("  Replay  ")) {
+            for (const auto &journal : journals) {
+                std::string report;
+                // the recovered layers are kept in the layer history, they are dirty until saved
+                for (const auto &layer : SessionJournal::replay(journal, report)) {
+                    editor.set_current_layer(layer, true);
+                }
+                std::cout << report << std::endl;
+                reports.push_back(std::move(report));
+            }
+        }
+    }
+    [[nodiscard]] const char *dialog_id() const override { return "Recover session"; }
+    Editor &editor;
+    std::vector<std::string> journals;
+    std::vector<std::string> reports;
+};
+
 void Editor::request_shutdown() const {
     if (!_isShutdown) {
         execute_after_draw<EditorShutdown>();
@@ -343,6 +387,21 @@ static void end_background_dock() {
     ImGui::End();
 }
 
+/// Progress of an undo or a redo running over several frames, the edits wait for its end
+static void draw_replay_progress() {
+    const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->GetCenter(), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+    ImGui::SetNextWindowSize(ImVec2(300.0f, 0.0f));
+    ImGui::SetNextWindowViewport(viewport->ID);
+    const ImGuiWindowFlags windowFlags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings |
+                                         ImGuiWindowFlags_NoDocking | ImGuiWindowFlags_NoNav;
+    if (ImGui::Begin("##ReplayProgress", nullptr, windowFlags)) {
+        ImGui::TextUnformatted("Undo/Redo in progress");
+        ImGui::ProgressBar(CommandStack::get_instance().get_replay_progress(), ImVec2(-1.0f, 0.0f));
+    }
+    ImGui::End();
+}
+
 /// Call back for dropping a file in the ui
 /// TODO Drop callback should popup a modal dialog with the different options available
 void Editor::drop_callback(GLFWwindow *window, int count, const char **paths) {
@@ -390,9 +449,17 @@ Editor::Editor()
     load_settings();
     set_file_browser_directory(_settings._lastFileBrowserDirectory);
     Blueprints::get_instance().set_blueprints_locations(_settings._blueprintLocations);
+    // A session which crashed may have journaled its edits even if the setting was turned off since
+    const auto journals = SessionJournal::find_orphans();
+    if (!journals.empty()) {
+        draw_modal_dialog<RecoverSessionModalDialog>(*this, journals);
+    }
+    CommandStack::get_instance().set_session_journal(_settings._sessionJournal);
 }
 
 Editor::~Editor() {
+    // A normal exit, the edits don't need to be recovered
+    CommandStack::get_instance().set_session_journal(false);
     _settings._lastFileBrowserDirectory = get_file_browser_directory();
     save_settings();
 }
@@ -520,6 +587,10 @@ Viewport &Editor::get_viewport() {
 }
 
 void Editor::hydra_render() {
+    // Hydra would sync from a stage whose composition is stale against the half replayed layers
+    if (CommandStack::get_instance().is_replaying()) {
+        return;
+    }
     _viewport.update();
     _viewport.render();
 }
@@ -612,6 +683,12 @@ void Editor::draw_main_menu_bar() {
                 _layerHistory.clear();
                 _layerHistoryPointer = 0;
             }
+            // the journal of a session must start with its first edit, the setting is applied at the next start
+            ImGui::MenuItem("Session journal", nullptr, &_settings._sessionJournal);
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Journal the edits to recover them after a crash, from the next start.\n"
+                                  "Every edit is then written to disk, arrays included, which slows down large edits.");
+            }
             ImGui::Separator();
             if (ImGui::MenuItem("Cut", "CTRL+X", false, false)) {
             }
@@ -658,6 +735,13 @@ void Editor::draw_main_menu_bar() {
 }
 
 void Editor::draw() {
+    // The layers are half replayed until the replay ends, and the stage only gets the notices then.
+    // Nothing reads them in between, only the progress is drawn.
+    if (CommandStack::get_instance().is_replaying()) {
+        draw_replay_progress();
+        return;
+    }
+
     // Main Menu bar
     draw_main_menu_bar();
 
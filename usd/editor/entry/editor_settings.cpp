@@ -67,6 +67,8 @@ void EditorSettings::parse_line(const char *line) {
         _showDebugWindow = static_cast<bool>(value);
     } else if (sscanf(line, "ShowArrayEditor=%i", &value) == 1) {
         _showSdfAttributeEditor = static_cast<bool>(value);
+    } else if (sscanf(line, "SessionJournal=%i", &value) == 1) {
+        _sessionJournal = static_cast<bool>(value);
     } else if (sscanf(line, "LastFileBrowserDirectory=%s", strBuffer) == 1) {
         _lastFileBrowserDirectory = strBuffer;
     } else if (strlen(line) > 12 && std::equal(line, line + 12, "RecentFiles=")) {
@@ -111,6 +113,7 @@ void EditorSettings::dump(ImGuiTextBuffer *buf) {
     buf->appendf("ShowLauncherBar=%d\n", _showLauncherBar);
     buf->appendf("ShowDebugWindow=%d\n", _showDebugWindow);
     buf->appendf("ShowArrayEditor=%d\n", _showSdfAttributeEditor);
+    buf->appendf("SessionJournal=%d\n", _sessionJournal);
     if (!_lastFileBrowserDirectory.empty()) {
         buf->appendf("LastFileBrowserDirectory=%s\n", _lastFileBrowserDirectory.c_str());
     }
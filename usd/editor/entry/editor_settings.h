@@ -32,6 +32,9 @@ struct EditorSettings {
     bool _showLauncherBar = false;
     bool _textEditor = false;
     bool _showSdfAttributeEditor = false;
+    /// Journal the edits to recover them after a crash. Off by default: every undo entry pushed is encoded,
+    /// arrays included, and flushed to disk, which slows down the edits of large data.
+    bool _sessionJournal = false;
     int _mainWindowWidth;
     int _mainWindowHeight;
 
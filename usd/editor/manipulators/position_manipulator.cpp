@@ -179,13 +179,18 @@ void PositionManipulator::on_begin_edition(Viewport &viewport) {
     _axisLine = GfLine(objectTransform.ExtractTranslation(), objectTransform.GetRow3(_selectedAxis));
     project_mouse_on_axis(viewport, _originMouseOnAxis);
 
-    begin_edition(viewport.get_current_stage());
+    _editSession.begin(viewport.get_current_stage());
 }
 
 Manipulator *PositionManipulator::on_update(Viewport &viewport) {
     if (ImGui::IsMouseReleased(0)) {
         return viewport.get_manipulator<MouseHoverManipulator>();
     }
+    if (ImGui::IsKeyPressed(ImGuiKey_Escape)) {
+        // back to the values from before the drag
+        _editSession.cancel();
+        return viewport.get_manipulator<MouseHoverManipulator>();
+    }
 
     if (_xformable && _selectedAxis < 3) {
         GfVec3d mouseOnAxis{};
@@ -200,22 +205,24 @@ Manipulator *PositionManipulator::on_update(Viewport &viewport) {
 
         GfVec3d translation = _translationOnBegin;
         translation[_selectedAxis] += sign * (_originMouseOnAxis - mouseOnAxis).GetLength();
-        if (_xformAPI) {
-            _xformAPI.SetTranslate(translation, get_edition_time_code(viewport));
-        } else {
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
-                GfMatrix4d current = ops[0].GetOpTransform(get_edition_time_code(viewport));
-                current.SetTranslateOnly(translation);// TODO: what happens if there is a pivot ???
-                ops[0].Set(current, get_edition_time_code(viewport));
+        _editSession.update([&] {
+            if (_xformAPI) {
+                _xformAPI.SetTranslate(translation, get_edition_time_code(viewport));
+            } else {
+                bool reset = false;
+                auto ops = _xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    GfMatrix4d current = ops[0].GetOpTransform(get_edition_time_code(viewport));
+                    current.SetTranslateOnly(translation);// TODO: what happens if there is a pivot ???
+                    ops[0].Set(current, get_edition_time_code(viewport));
+                }
             }
-        }
+        });
     }
     return this;
 }
 
-void PositionManipulator::on_end_edition(Viewport &) { end_edition(); };
+void PositionManipulator::on_end_edition(Viewport &) { _editSession.commit(); }
 
 ///
 void PositionManipulator::project_mouse_on_axis(const Viewport &viewport, GfVec3d &linePoint) {
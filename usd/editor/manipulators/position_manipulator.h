@@ -13,6 +13,7 @@
 #include <pxr/usd/usdGeom/gprim.h>
 #include <pxr/usd/usdGeom/xformCommonAPI.h>
 
+#include "commands/command_stack.h"
 #include "manipulator.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
@@ -53,6 +54,9 @@ private:
 
     UsdGeomXformable _xformable;
     UsdGeomXformCommonAPI _xformAPI;
+
+    /// Open during a drag
+    ScopedEditSession _editSession;
 };
 
 }// namespace vox
\ No newline at end of file
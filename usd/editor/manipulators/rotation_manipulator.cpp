@@ -234,13 +234,18 @@ void RotationManipulator::on_begin_edition(Viewport &viewport) {
         _rotateMatrixOnBegin =
             UsdGeomXformOp::GetOpTransform(UsdGeomXformCommonAPI::ConvertRotationOrderToOpType(rotOrder), VtValue(rotation));
     }
-    begin_edition(viewport.get_current_stage());
+    _editSession.begin(viewport.get_current_stage());
 }
 
 Manipulator *RotationManipulator::on_update(Viewport &viewport) {
     if (ImGui::IsMouseReleased(0)) {
         return viewport.get_manipulator<MouseHoverManipulator>();
     }
+    if (ImGui::IsKeyPressed(ImGuiKey_Escape)) {
+        // back to the values from before the drag
+        _editSession.cancel();
+        return viewport.get_manipulator<MouseHoverManipulator>();
+    }
     if (_xformable && _selectedAxis != None) {
 
         // Compute rotation angle in world coordinates
@@ -281,25 +286,27 @@ Manipulator *RotationManipulator::on_update(Viewport &viewport) {
         GfRotation::DecomposeRotation(resultingRotation, xAxis, yAxis, zAxis, 1.0, &thetaTw, &thetaFB, &thetaLR, &thetaSw, true);
         const GfVec3f newRotationValues =
             GfVec3f(GfRadiansToDegrees(thetaTw), GfRadiansToDegrees(thetaFB), GfRadiansToDegrees(thetaLR));
-        if (_xformAPI) {
-            _xformAPI.SetRotate(newRotationValues, rotOrder, get_edition_time_code(viewport));
-        } else {// Modify only if we have a single matrix
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
-                // [ "xformOp:translate", "xformOp:translate:pivot", "xformOp:rotateXYZ",
-                // "xformOp:scale", "!invert!xformOp:translate:pivot" ] - No pivot here
-                GfMatrix4d current = GfMatrix4d().SetScale(scale) * _rotateMatrixOnBegin *
-                                     GfMatrix4d(1.0).SetRotate(deltaRotation) * GfMatrix4d().SetTranslate(translation);
-                ops[0].Set(current, get_edition_time_code(viewport));
+        _editSession.update([&] {
+            if (_xformAPI) {
+                _xformAPI.SetRotate(newRotationValues, rotOrder, get_edition_time_code(viewport));
+            } else {// Modify only if we have a single matrix
+                bool reset = false;
+                auto ops = _xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    // [ "xformOp:translate", "xformOp:translate:pivot", "xformOp:rotateXYZ",
+                    // "xformOp:scale", "!invert!xformOp:translate:pivot" ] - No pivot here
+                    GfMatrix4d current = GfMatrix4d().SetScale(scale) * _rotateMatrixOnBegin *
+                                         GfMatrix4d(1.0).SetRotate(deltaRotation) * GfMatrix4d().SetTranslate(translation);
+                    ops[0].Set(current, get_edition_time_code(viewport));
+                }
             }
-        }
+        });
     }
 
     return this;
 }
 
-void RotationManipulator::on_end_edition(Viewport &) { end_edition(); }
+void RotationManipulator::on_end_edition(Viewport &) { _editSession.commit(); }
 
 // TODO code should be shared with position manipulator
 UsdTimeCode RotationManipulator::get_edition_time_code(const Viewport &viewport) {
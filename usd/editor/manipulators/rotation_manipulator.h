@@ -13,6 +13,7 @@
 #include <pxr/usd/usdGeom/gprim.h>
 #include <pxr/usd/usdGeom/xformCommonAPI.h>
 #include <imgui.h>
+#include "commands/command_stack.h"
 #include "manipulator.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
@@ -59,6 +60,9 @@ private:
 
     std::vector<GfVec2d> _manipulatorCircles;
     std::vector<ImVec2> _manipulator2dPoints;
+
+    /// Open during a drag
+    ScopedEditSession _editSession;
 };
 
 }// namespace vox
\ No newline at end of file
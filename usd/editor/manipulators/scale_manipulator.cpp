@@ -155,13 +155,18 @@ void ScaleManipulator::on_begin_edition(Viewport &viewport) {
     _axisLine = GfLine(objectTransform.ExtractTranslation(), objectTransform.GetRow3(_selectedAxis));
     project_mouse_on_axis(viewport, _originMouseOnAxis);
 
-    begin_edition(viewport.get_current_stage());
+    _editSession.begin(viewport.get_current_stage());
 }
 
 Manipulator *ScaleManipulator::on_update(Viewport &viewport) {
     if (ImGui::IsMouseReleased(0)) {
         return viewport.get_manipulator<MouseHoverManipulator>();
     }
+    if (ImGui::IsKeyPressed(ImGuiKey_Escape)) {
+        // back to the values from before the drag
+        _editSession.cancel();
+        return viewport.get_manipulator<MouseHoverManipulator>();
+    }
 
     if (_xformable && _selectedAxis < 3) {
         GfVec3d mouseOnAxis{};
@@ -186,28 +191,30 @@ Manipulator *ScaleManipulator::on_update(Viewport &viewport) {
             scale[_selectedAxis] = _scaleOnBegin[_selectedAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
         }
 
-        if (_xformAPI) {
-            _xformAPI.SetScale(scale, get_edition_time_code(viewport));
-        } else {
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
-                GfVec3d translation{};
-                GfVec3f scale_{}, pivot{}, rotation{};
-                UsdGeomXformCommonAPI::RotationOrder rotOrder;
-                _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &scale_, &pivot, &rotOrder,
-                                                        get_edition_time_code(viewport));
-                const auto transMat = GfMatrix4d(1.0).SetTranslate(translation);
-                const auto rotMat = _xformAPI.GetRotationTransform(rotation, rotOrder);
-                GfMatrix4d current = GfMatrix4d().SetScale(scale) * rotMat * transMat;
-                ops[0].Set(current, get_edition_time_code(viewport));
+        _editSession.update([&] {
+            if (_xformAPI) {
+                _xformAPI.SetScale(scale, get_edition_time_code(viewport));
+            } else {
+                bool reset = false;
+                auto ops = _xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    GfVec3d translation{};
+                    GfVec3f scale_{}, pivot{}, rotation{};
+                    UsdGeomXformCommonAPI::RotationOrder rotOrder;
+                    _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &scale_, &pivot, &rotOrder,
+                                                            get_edition_time_code(viewport));
+                    const auto transMat = GfMatrix4d(1.0).SetTranslate(translation);
+                    const auto rotMat = _xformAPI.GetRotationTransform(rotation, rotOrder);
+                    GfMatrix4d current = GfMatrix4d().SetScale(scale) * rotMat * transMat;
+                    ops[0].Set(current, get_edition_time_code(viewport));
+                }
             }
-        }
+        });
     }
     return this;
 }
 
-void ScaleManipulator::on_end_edition(Viewport &) { end_edition(); }
+void ScaleManipulator::on_end_edition(Viewport &) { _editSession.commit(); }
 
 ///
 void ScaleManipulator::project_mouse_on_axis(const Viewport &viewport, GfVec3d &linePoint) {
@@ -13,6 +13,7 @@
 #include <pxr/usd/usdGeom/gprim.h>
 #include <pxr/usd/usdGeom/xformCommonAPI.h>
 
+#include "commands/command_stack.h"
 #include "manipulator.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
@@ -51,6 +52,9 @@ private:
     GfLine _axisLine;
 
     UsdGeomXformCommonAPI _xformAPI;
+
+    /// Open during a drag
+    ScopedEditSession _editSession;
     UsdGeomXformable _xformable;
 };
 
@@ -5,6 +5,7 @@
 //  property of any third parties.
 
 #include "debug.h"
+#include "commands/command_stack.h"
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -136,12 +137,40 @@ static void draw_plugins() {
     }
 }
 
+static void draw_undo_history() {
+    CommandStack &commandStack = CommandStack::get_instance();
+    ImGui::Text("Steps: %zu (position %d)", commandStack.get_undo_steps(), commandStack.get_undo_position());
+    ImGui::Text("Memory: %.2f MiB", double(commandStack.get_undo_memory_usage()) / (1024.0 * 1024.0));
+    if (const size_t instructions = commandStack.get_undo_instruction_count()) {
+        ImGui::Text("Instructions: %zu (%.1f bytes each)", instructions,
+                    double(commandStack.get_undo_memory_usage()) / double(instructions));
+    }
+
+    int budgetMiB = int(commandStack.get_undo_budget_bytes() >> 20);
+    int budgetSteps = int(commandStack.get_undo_budget_steps());
+    // applied on Enter only, the values typed on the way to the final one would evict the history
+    bool changed = ImGui::InputInt("Budget (MiB)", &budgetMiB, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
+    changed |= ImGui::InputInt("Budget (steps)", &budgetSteps, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
+    if (changed) {
+        commandStack.set_undo_budget(size_t(std::max(budgetMiB, 1)) << 20, size_t(std::max(budgetSteps, 1)));
+    }
+
+    bool journal = commandStack.is_undo_journal_enabled();
+    if (ImGui::Checkbox("Write older steps to a journal", &journal)) {
+        commandStack.set_undo_journal(journal);
+    }
+    if (journal) {
+        ImGui::Text("Journal: %zu steps, %.2f MiB", commandStack.get_undo_journaled_steps(),
+                    double(commandStack.get_undo_journal_size()) / (1024.0 * 1024.0));
+    }
+}
+
 // Draw a preference like panel
 void draw_debug_ui() {
-    static const char *const panels[] = {"Timings", "Debug codes", "Trace reporter", "Plugins"};
+    static const char *const panels[] = {"Timings", "Debug codes", "Trace reporter", "Plugins", "Undo history"};
     static int current_item = 0;
     ImGui::PushItemWidth(100);
-    ImGui::ListBox("##DebugPanels", &current_item, panels, 4);
+    ImGui::ListBox("##DebugPanels", &current_item, panels, 5);
     ImGui::SameLine();
     if (current_item == 0) {
         ImGui::BeginChild("##Timing");
@@ -159,6 +188,10 @@ void draw_debug_ui() {
         ImGui::BeginChild("##Plugins");
         draw_plugins();
         ImGui::EndChild();
+    } else if (current_item == 4) {
+        ImGui::BeginChild("##UndoHistory");
+        draw_undo_history();
+        ImGui::EndChild();
     }
 }
 
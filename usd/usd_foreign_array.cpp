@@ -0,0 +1,31 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "usd_foreign_array.h"
+
+namespace vox {
+namespace {
+// heap allocated, deletes itself once the last VtArray referencing it is gone
+class OwnedDataSource : public pxr::Vt_ArrayForeignDataSource {
+public:
+    explicit OwnedDataSource(std::shared_ptr<const void> owner)
+        : pxr::Vt_ArrayForeignDataSource(&OwnedDataSource::_detached),
+          _owner(std::move(owner)) {}
+
+private:
+    static void _detached(pxr::Vt_ArrayForeignDataSource *self) {
+        delete static_cast<OwnedDataSource *>(self);
+    }
+
+    std::shared_ptr<const void> _owner;
+};
+}// namespace
+
+pxr::Vt_ArrayForeignDataSource *make_foreign_data_source(std::shared_ptr<const void> owner) {
+    return new OwnedDataSource(std::move(owner));
+}
+
+}// namespace vox
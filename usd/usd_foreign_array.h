@@ -0,0 +1,36 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <pxr/base/vt/array.h>
+
+#include <memory>
+#include <span>
+
+namespace vox {
+/// Foreign data source keeping owner alive while VtArrays reference its memory.
+pxr::Vt_ArrayForeignDataSource *make_foreign_data_source(std::shared_ptr<const void> owner);
+
+/// Make a VtArray over caller memory.
+///
+/// Without owner, the data is copied and the span may be reused as soon as the call returns.
+/// With owner, no copy is made: the array points into data, and every copy of it (the time samples of the layer, the
+/// values kept for change detection, ...) shares the owner. The memory must stay valid and unmodified as long as
+/// owner is alive; the last reference may be dropped on any thread, for instance on a writer thread or when the stage
+/// is released. Writing to the array detaches it into a private copy.
+template<typename T>
+pxr::VtArray<T> make_vt_array(std::span<const T> data, std::shared_ptr<const void> owner = nullptr) {
+    if (!owner) {
+        pxr::VtArray<T> array;
+        array.assign(data.begin(), data.end());
+        return array;
+    }
+    // VtArray never writes through foreign data, so casting away const is safe
+    return pxr::VtArray<T>(make_foreign_data_source(std::move(owner)), const_cast<T *>(data.data()), data.size());
+}
+
+}// namespace vox
@@ -5,8 +5,18 @@
 //  property of any third parties.
 
 #include "usd_primitive.h"
-
-#include <pxr/base/gf/rotation.h>
+#include "usd_segment_xform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#include <pxr/base/arch/hash.h>
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/sdf/attributeSpec.h>
+#include <pxr/usd/sdf/changeBlock.h>
+#include <pxr/usd/sdf/schema.h>
+#include <pxr/usd/usd/clipsAPI.h>
 #include <pxr/usd/usdGeom/metrics.h>
 #include <pxr/usd/usdGeom/mesh.h>
 #include <pxr/usd/usdGeom/scope.h>
@@ -18,41 +28,683 @@
 #include <pxr/usd/usdGeom/pointInstancer.h>
 #include <pxr/usd/usdGeom/points.h>
 #include <pxr/usd/usdLux/distantLight.h>
+#include "common/logging.h"
 
 namespace vox {
 namespace {
-void _usd_add_xform(const pxr::UsdSchemaBase &schemaBase) {
-    auto prim = pxr::UsdGeomXform(schemaBase);
-    prim.ClearXformOpOrder();
-    auto t = prim.AddTransformOp();
-    auto r = prim.AddOrientOp();
-    auto s = prim.AddScaleOp();
+template<typename... Ts>
+size_t _payload_bytes_of(const pxr::VtValue &value) {
+    size_t bytes = 0;
+    ((value.IsHolding<Ts>() ? bytes = sizeof(Ts) : 0), ...);
+    ((value.IsHolding<pxr::VtArray<Ts>>() ? bytes = value.UncheckedGet<pxr::VtArray<Ts>>().size() * sizeof(Ts) : 0), ...);
+    return bytes;
+}
+
+// size of the data of the values the renderer authors, other types count as 0
+size_t _payload_bytes(const pxr::VtValue &value) {
+    return _payload_bytes_of<int, float, double, pxr::GfVec3f, pxr::GfVec3h, pxr::GfQuatf, pxr::GfQuath>(value);
+}
+
+template<typename T>
+uint64_t _content_hash(const pxr::VtArray<T> &array) {
+    return pxr::ArchHash64(reinterpret_cast<const char *>(array.cdata()), array.size() * sizeof(T));
+}
+
+// a triangle list indexing num_points points
+bool _valid_triangles(const pxr::VtIntArray &indices, size_t num_points) {
+    if (indices.size() % 3 != 0) {
+        return false;
+    }
+    return std::all_of(indices.cbegin(), indices.cend(),
+                       [num_points](int index) { return index >= 0 && size_t(index) < num_points; });
+}
+
+bool _close(double a, double b, float epsilon) {
+    return std::abs(a - b) <= epsilon;
+}
+
+bool _close(const pxr::GfVec3f &a, const pxr::GfVec3f &b, float epsilon) {
+    return _close(a[0], b[0], epsilon) && _close(a[1], b[1], epsilon) && _close(a[2], b[2], epsilon);
+}
+
+bool _close(const pxr::GfVec3h &a, const pxr::GfVec3h &b, float epsilon) {
+    return _close(pxr::GfVec3f(a), pxr::GfVec3f(b), epsilon);
 }
 
-void _usd_set_xform(const pxr::UsdSchemaBase &schemaBase, pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f scale, float time) {
-    auto xform = pxr::UsdGeomXform(schemaBase);
+float _max_error(const pxr::GfVec3f &a, const pxr::GfVec3f &b) {
+    return std::max({std::abs(a[0] - b[0]), std::abs(a[1] - b[1]), std::abs(a[2] - b[2])});
+}
+
+template<typename QuatT>
+bool _close_quat(const QuatT &a, const QuatT &b, float epsilon) {
+    return _close(double(a.GetReal()), double(b.GetReal()), epsilon) &&
+           _close(pxr::GfVec3f(a.GetImaginary()), pxr::GfVec3f(b.GetImaginary()), epsilon);
+}
 
-    bool resetsXformStack;
-    std::vector<pxr::UsdGeomXformOp> xform_ops = xform.GetOrderedXformOps(&resetsXformStack);
-    xform_ops[0].Set(pos, time);
-    xform_ops[1].Set(rot, time);
-    xform_ops[2].Set(scale, time);
-    xform.SetXformOpOrder(xform_ops);
+bool _close(const pxr::GfQuatf &a, const pxr::GfQuatf &b, float epsilon) {
+    return _close_quat(a, b, epsilon);
+}
+
+bool _close(const pxr::GfQuath &a, const pxr::GfQuath &b, float epsilon) {
+    return _close_quat(a, b, epsilon);
+}
+
+template<typename T>
+bool _close(const pxr::VtArray<T> &a, const pxr::VtArray<T> &b, float epsilon) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    if (a.IsIdentical(b)) {
+        return true;
+    }
+    const T *a_data = a.cdata();
+    const T *b_data = b.cdata();
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!_close(a_data[i], b_data[i], epsilon)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-// transforms a cylinder such that it connects the two points pos0, pos1
-std::tuple<pxr::GfVec3f, pxr::GfQuath, pxr::GfVec3f> _compute_segment_xform(pxr::GfVec3f pos0, pxr::GfVec3f pos1) {
-    auto mid = (pos0 + pos1) * 0.5;
-    auto height = (pos1 - pos0).GetLength();
-    auto dir = (pos1 - pos0) / height;
+template<typename T>
+bool _close_as(const pxr::VtValue &a, const pxr::VtValue &b, float epsilon) {
+    return _close(a.UncheckedGet<T>(), b.UncheckedGet<T>(), epsilon);
+}
 
-    pxr::GfRotation rot{pxr::GfVec3d(0.0, 0.0, 1.0), pxr::GfVec3d(dir)};
-    auto scale = pxr::GfVec3f(1.0, 1.0, height);
-    return {mid, pxr::GfQuath(rot.GetQuat()), scale};
+// floating-point values compare component-wise within epsilon, anything else exactly
+bool _nearly_equal(const pxr::VtValue &a, const pxr::VtValue &b, float epsilon) {
+    if (a.GetType() != b.GetType()) {
+        return false;
+    }
+    if (a.IsHolding<float>()) return _close(a.UncheckedGet<float>(), b.UncheckedGet<float>(), epsilon);
+    if (a.IsHolding<double>()) return _close(a.UncheckedGet<double>(), b.UncheckedGet<double>(), epsilon);
+    if (a.IsHolding<pxr::GfVec3f>()) return _close_as<pxr::GfVec3f>(a, b, epsilon);
+    if (a.IsHolding<pxr::GfVec3h>()) return _close_as<pxr::GfVec3h>(a, b, epsilon);
+    if (a.IsHolding<pxr::GfQuatf>()) return _close_as<pxr::GfQuatf>(a, b, epsilon);
+    if (a.IsHolding<pxr::GfQuath>()) return _close_as<pxr::GfQuath>(a, b, epsilon);
+    if (a.IsHolding<pxr::VtVec3fArray>()) return _close_as<pxr::VtVec3fArray>(a, b, epsilon);
+    if (a.IsHolding<pxr::VtQuathArray>()) return _close_as<pxr::VtQuathArray>(a, b, epsilon);
+    if (a.IsHolding<pxr::VtFloatArray>()) return _close_as<pxr::VtFloatArray>(a, b, epsilon);
+    return a == b;
 }
 }// namespace
 
+template<typename SchemaT>
+UsdRenderer::_PrimEntry &UsdRenderer::_get_or_define(const pxr::SdfPath &path, bool add_xform, bool *created) {
+    auto iter = _prims.find(path);
+    if (iter != _prims.end()) {
+        if (created) *created = false;
+        return iter->second;
+    }
+
+    _PrimEntry entry;
+    entry.prim = SchemaT::Define(_stage, path).GetPrim();
+    entry.shard = _shard_of(path);
+    if (add_xform) {
+        const auto precision = _precision == Precision::Half ? pxr::UsdGeomXformOp::PrecisionHalf
+                                                             : pxr::UsdGeomXformOp::PrecisionFloat;
+        auto xform = pxr::UsdGeomXformable(entry.prim);
+        xform.ClearXformOpOrder();
+        entry.translate.attr = xform.AddTranslateOp(precision).GetAttr();
+        entry.orient.attr = xform.AddOrientOp(precision).GetAttr();
+        entry.scale.attr = xform.AddScaleOp(precision).GetAttr();
+        entry.precision = _precision;
+        entry.translate.shard = entry.orient.shard = entry.scale.shard = entry.shard;
+    }
+    if (created) *created = true;
+    return _prims.emplace(path, std::move(entry)).first->second;
+}
+
+std::pair<pxr::SdfPath, pxr::SdfPath> UsdRenderer::_resolve_shape_paths(const pxr::TfToken &name, const pxr::TfToken &shape,
+                                                                        const std::optional<pxr::TfToken> &parent_body,
+                                                                        bool is_template) {
+    if (!is_template) {
+        auto shape_path = _resolve_path(name, parent_body);
+        return {shape_path, shape_path};
+    }
+
+    auto prim_path = _resolve_path(name, parent_body, is_template);
+    bool created;
+    auto &blueprint = _get_or_define<pxr::UsdGeomScope>(prim_path, false, &created);
+    if (created) {
+        blueprint.prim.SetInstanceable(true);
+        blueprint.prim.SetSpecifier(pxr::SdfSpecifierClass);
+    }
+    return {prim_path, prim_path.AppendChild(shape)};
+}
+
+UsdRenderer::_AttrSlot &UsdRenderer::_attr(_PrimEntry &entry, const pxr::TfToken &name) {
+    auto iter = entry.attrs.find(name);
+    if (iter == entry.attrs.end()) {
+        iter = entry.attrs.emplace(name, _AttrSlot{entry.prim.GetAttribute(name)}).first;
+        iter->second.shard = entry.shard;
+    }
+    return iter->second;
+}
+
+void UsdRenderer::_set_interpolation(_AttrSlot &slot, const pxr::TfToken &interpolation) {
+    if (slot.interpolation != interpolation) {
+        // same metadata as UsdGeomPrimvar::SetInterpolation, which also covers the widths of points
+        slot.attr.SetMetadata(pxr::UsdGeomTokens->interpolation, interpolation);
+        slot.interpolation = interpolation;
+    }
+}
+
+void UsdRenderer::_set_xform(_PrimEntry &entry, pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f scale, float time) {
+    if (entry.precision == Precision::Half) {
+        const pxr::GfVec3h pos_h(pos);
+        const pxr::GfQuath rot_h(rot);
+        const pxr::GfVec3h scale_h(scale);
+
+        auto &report = _precision_report;
+        report.max_translate_error = std::max(report.max_translate_error, _max_error(pos, pxr::GfVec3f(pos_h)));
+        report.max_orient_error = std::max({report.max_orient_error,
+                                            std::abs(rot.GetReal() - float(rot_h.GetReal())),
+                                            _max_error(rot.GetImaginary(), pxr::GfVec3f(rot_h.GetImaginary()))});
+        report.max_scale_error = std::max(report.max_scale_error, _max_error(scale, pxr::GfVec3f(scale_h)));
+
+        _write_sample(entry.translate, pxr::VtValue(pos_h), time);
+        _write_sample(entry.orient, pxr::VtValue(rot_h), time);
+        _write_sample(entry.scale, pxr::VtValue(scale_h), time);
+        return;
+    }
+
+    _write_sample(entry.translate, pxr::VtValue(pos), time);
+    _write_sample(entry.orient, pxr::VtValue(rot), time);
+    _write_sample(entry.scale, pxr::VtValue(scale), time);
+}
+
+void UsdRenderer::_write(_AttrSlot &slot, pxr::VtValue value, pxr::UsdTimeCode time) {
+    if (_in_frame) {
+        auto &writes = slot.shard >= 0 ? _shard_writes[slot.shard] : _pending_writes;
+        writes.push_back({&slot, std::move(value), time});
+    } else {
+        _author(slot, value, time);
+    }
+}
+
+bool UsdRenderer::_write_if_changed(_AttrSlot &slot, pxr::VtValue value, uint64_t hash, pxr::UsdTimeCode time) {
+    const bool changed = slot.last_value.IsEmpty() || slot.hash != hash;
+    slot.hash = hash;
+    return _hold_or_write(slot, changed, std::move(value), time);
+}
+
+bool UsdRenderer::_write_topology(_AttrSlot &slot, pxr::VtValue value, uint64_t hash) {
+    if (slot.last_value.IsEmpty()) {
+        slot.hash = hash;
+        slot.last_value = value;
+        slot.default_time = _time;
+        _write(slot, std::move(value));
+        return true;
+    }
+    if (slot.default_time.has_value()) {
+        if (slot.hash == hash) {
+            return false;
+        }
+        // samples override the default at every time, the first topology becomes the first sample
+        _write(slot, slot.last_value, slot.default_time.value());
+        slot.default_time.reset();
+    }
+    return _write_if_changed(slot, std::move(value), hash, _time);
+}
+
+bool UsdRenderer::_write_sample(_AttrSlot &slot, pxr::VtValue value, pxr::UsdTimeCode time) {
+    // compared against the last written value rather than the last skipped one, so slow drift is still recorded
+    const bool changed = slot.last_value.IsEmpty() || !_nearly_equal(slot.last_value, value, _change_epsilon);
+    return _hold_or_write(slot, changed, std::move(value), time);
+}
+
+bool UsdRenderer::_hold_or_write(_AttrSlot &slot, bool changed, pxr::VtValue value, pxr::UsdTimeCode time) {
+    if (!changed) {
+        slot.held_time = time;
+        return false;
+    }
+
+    if (slot.held_time.has_value()) {
+        _write(slot, slot.last_value, slot.held_time.value());
+        slot.held_time.reset();
+    }
+    slot.last_value = value;
+    _write(slot, std::move(value), time);
+    return true;
+}
+
+void UsdRenderer::_collapse(_AttrSlot &slot) {
+    if (slot.last_value.IsEmpty() || !slot.attr) {
+        return;
+    }
+    const auto layer = _layer_of(slot);
+    const auto &path = slot.attr.GetPath();
+    if (layer->GetNumTimeSamplesForPath(path) != 1) {
+        return;
+    }
+
+    const double time = *layer->ListTimeSamplesForPath(path).begin();
+    pxr::VtValue value;
+    layer->QueryTimeSample(path, time, &value);
+    layer->SetField(path, pxr::SdfFieldKeys->Default, value);
+    layer->EraseTimeSample(path, time);
+    // if the value changes later, the hold rule re-authors it as a sample before the new one
+    if (!slot.held_time.has_value()) {
+        slot.held_time = pxr::UsdTimeCode(time);
+    }
+}
+
+int UsdRenderer::_shard_of(const pxr::SdfPath &path) const {
+    if (_body_shards.empty()) {
+        return -1;
+    }
+    for (auto prefix = path; prefix.GetPathElementCount() > 1; prefix = prefix.GetParentPath()) {
+        auto iter = _body_shards.find(prefix);
+        if (iter != _body_shards.end()) {
+            return iter->second;
+        }
+    }
+    return -1;
+}
+
+pxr::SdfLayerHandle UsdRenderer::_layer_of(const _AttrSlot &slot) const {
+    return slot.shard >= 0 ? pxr::SdfLayerHandle(_shards[slot.shard]) : _layer;
+}
+
+void UsdRenderer::set_flush_mode(FlushMode mode) {
+    flush();
+    _flush_mode = mode;
+}
+
+void UsdRenderer::set_skip_unchanged_points(bool skip) {
+    flush();
+    _skip_unchanged_points = skip;
+}
+
+void UsdRenderer::set_change_epsilon(float epsilon) {
+    flush();
+    _change_epsilon = epsilon;
+}
+
+void UsdRenderer::set_precision(Precision precision) {
+    flush();
+    _precision = precision;
+    _precision_report = {};
+}
+
+PrecisionReport UsdRenderer::precision_report() {
+    flush();
+    return _precision_report;
+}
+
+void UsdRenderer::set_sharded(size_t num_shards, ShardOutput output) {
+    flush();
+    if (!_shards.empty()) {
+        LOGE("UsdRenderer::set_sharded can only be called once");
+        return;
+    }
+
+    _shard_output = output;
+    for (size_t i = 0; i < num_shards; ++i) {
+        _shards.push_back(pxr::SdfLayer::CreateAnonymous(fmt::format("shard{}", i)));
+    }
+    _shard_writes.resize(num_shards);
+}
+
+void UsdRenderer::_output_shards() {
+    if (_shards.empty()) {
+        return;
+    }
+
+    if (_shard_output == ShardOutput::Sublayers) {
+        const std::filesystem::path root_path{_layer->GetRealPath()};
+        if (!root_path.empty()) {
+            for (size_t i = 0; i < _shards.size(); ++i) {
+                auto shard_path = root_path;
+                shard_path.replace_extension(fmt::format("shard{}.usdc", i));
+                _shards[i]->Export(shard_path.string());
+
+                const auto sublayer = "./" + shard_path.filename().string();
+                if (_layer->GetSubLayerPaths().Find(sublayer) == size_t(-1)) {
+                    _layer->InsertSubLayerPath(sublayer);
+                }
+            }
+            return;
+        }
+        LOGE("shards of an in-memory stage cannot be exported, merging them instead");
+    }
+
+    pxr::SdfChangeBlock block;
+    _for_each_slot([&](_AttrSlot &slot) {
+        if (slot.shard < 0 || !slot.shard_spec) {
+            return;
+        }
+        const auto &shard = _shards[slot.shard];
+        const auto &path = slot.attr.GetPath();
+        if (!_layer->HasSpec(path)) {
+            pxr::SdfJustCreatePrimAttributeInLayer(_layer, path, slot.attr.GetTypeName());
+        }
+
+        pxr::VtValue value;
+        if (shard->HasField(path, pxr::SdfFieldKeys->Default, &value)) {
+            _layer->SetField(path, pxr::SdfFieldKeys->Default, value);
+            shard->EraseField(path, pxr::SdfFieldKeys->Default);
+        }
+        for (double time : shard->ListTimeSamplesForPath(path)) {
+            shard->QueryTimeSample(path, time, &value);
+            _layer->SetTimeSample(path, time, value);
+        }
+        shard->EraseField(path, pxr::SdfFieldKeys->TimeSamples);
+    });
+}
+
+void UsdRenderer::_for_each_slot(const std::function<void(_AttrSlot &)> &fn) {
+    for (auto &[path, entry] : _prims) {
+        fn(entry.translate);
+        fn(entry.orient);
+        fn(entry.scale);
+        for (auto &[name, slot] : entry.attrs) {
+            fn(slot);
+        }
+    }
+}
+
+void UsdRenderer::finalize() {
+    flush();
+    if (_in_frame) {
+        LOGE("UsdRenderer::finalize called inside a frame");
+        return;
+    }
+
+    if (_chunk_frames > 0) {
+        // collapsing would resolve the samples through every clip layer at once
+        _flush_chunk();
+    } else {
+        _for_each_slot([this](_AttrSlot &slot) { _collapse(slot); });
+    }
+    _output_shards();
+}
+
+void UsdRenderer::set_chunked(size_t frames_per_chunk, const std::string &clip_prefix) {
+    flush();
+    if (_chunk_frames > 0) {
+        _flush_chunk();
+    }
+
+    _chunk_frames = frames_per_chunk;
+    _chunk_frame_count = 0;
+    if (_chunk_frames == 0) {
+        return;
+    }
+
+    _clip_prefix = clip_prefix;
+    if (_clip_prefix.empty()) {
+        std::filesystem::path root_path{_layer->GetRealPath()};
+        if (root_path.empty()) {
+            LOGE("chunked recording of an in-memory stage requires a clip prefix");
+            _chunk_frames = 0;
+            return;
+        }
+        _clip_prefix = root_path.replace_extension().string();
+    }
+
+    if (!_clip_manifest) {
+        _clip_manifest = pxr::SdfLayer::CreateNew(_clip_prefix + ".manifest.usda");
+        if (!_clip_manifest) {
+            LOGE("failed to create the clip manifest {}.manifest.usda", _clip_prefix);
+            _chunk_frames = 0;
+        }
+    }
+}
+
+void UsdRenderer::_flush_chunk() {
+    if (!_chunk_start.has_value()) {
+        return;
+    }
+    const double chunk_start = _chunk_start.value();
+    _chunk_start.reset();
+    _chunk_frame_count = 0;
+
+    const auto clip_index = _clip_assets.size();
+    const auto clip_path = fmt::format("{}.{:04}.usdc", _clip_prefix, clip_index);
+    auto clip = pxr::SdfLayer::CreateNew(clip_path);
+    if (!clip) {
+        LOGE("failed to create clip layer {}", clip_path);
+        return;
+    }
+
+    // Every clip must hold the value of each attribute over its whole range: values held by skipped samples are
+    // authored at their last skipped time, attributes not written in this chunk carry the tail of the previous clip.
+    _for_each_slot([&](_AttrSlot &slot) {
+        if (!slot.attr) {
+            return;
+        }
+        if (slot.held_time.has_value()) {
+            _author(slot, slot.last_value, slot.held_time.value());
+            slot.held_time.reset();
+        } else if (!slot.chunk_tail.IsEmpty() && _layer_of(slot)->GetNumTimeSamplesForPath(slot.attr.GetPath()) == 0) {
+            _author(slot, slot.chunk_tail, chunk_start);
+        }
+    });
+
+    {
+        pxr::SdfChangeBlock block;
+        _for_each_slot([&](_AttrSlot &slot) {
+            if (!slot.attr) {
+                return;
+            }
+            const auto layer = _layer_of(slot);
+            const auto &attr_path = slot.attr.GetPath();
+            auto samples = layer->GetField(attr_path, pxr::SdfFieldKeys->TimeSamples);
+            if (!samples.IsHolding<pxr::SdfTimeSampleMap>()) {
+                return;
+            }
+            const auto &sample_map = samples.UncheckedGet<pxr::SdfTimeSampleMap>();
+            if (sample_map.empty()) {
+                return;
+            }
+            slot.chunk_tail = sample_map.rbegin()->second;
+
+            const auto type_name = slot.attr.GetTypeName();
+            pxr::SdfJustCreatePrimAttributeInLayer(clip, attr_path, type_name);
+            clip->SetField(attr_path, pxr::SdfFieldKeys->TimeSamples, samples);
+            if (!_clip_manifest->HasSpec(attr_path)) {
+                pxr::SdfJustCreatePrimAttributeInLayer(_clip_manifest, attr_path, type_name);
+            }
+            layer->EraseField(attr_path, pxr::SdfFieldKeys->TimeSamples);
+        });
+    }
+    clip->Save();
+    _clip_manifest->Save();
+
+    // clip asset paths are relative to the root layer, which sits next to the clips
+    const auto relative_path = [](const std::string &path) {
+        return "./" + std::filesystem::path(path).filename().string();
+    };
+    _clip_assets.push_back(pxr::SdfAssetPath(relative_path(clip_path)));
+    _clip_active.push_back(pxr::GfVec2d(chunk_start, double(clip_index)));
+    _clip_times.push_back(pxr::GfVec2d(chunk_start, chunk_start));
+
+    pxr::UsdClipsAPI clips(_root.GetPrim());
+    clips.SetClipPrimPath(_root.GetPath().GetString());
+    clips.SetClipManifestAssetPath(pxr::SdfAssetPath(relative_path(_clip_manifest->GetRealPath())));
+    clips.SetClipAssetPaths(_clip_assets);
+    clips.SetClipActive(_clip_active);
+    clips.SetClipTimes(_clip_times);
+}
+
+void UsdRenderer::save() {
+    finalize();
+    _stage->Save();
+}
+
+void UsdRenderer::_author(_AttrSlot &slot, const pxr::VtValue &value, pxr::UsdTimeCode time) {
+    _values_written.fetch_add(1, std::memory_order_relaxed);
+    _bytes_written.fetch_add(_payload_bytes(value), std::memory_order_relaxed);
+
+    if (slot.shard >= 0) {
+        // shards are detached from the stage, their specs are created directly
+        const auto &shard = _shards[slot.shard];
+        const auto &path = slot.attr.GetPath();
+        if (!slot.shard_spec) {
+            pxr::SdfJustCreatePrimAttributeInLayer(shard, path, slot.attr.GetTypeName());
+            slot.shard_spec = true;
+        }
+        if (time.IsDefault()) {
+            shard->SetField(path, pxr::SdfFieldKeys->Default, value);
+        } else {
+            shard->SetTimeSample(path, time.GetValue(), value);
+        }
+        return;
+    }
+
+    if (_flush_mode == FlushMode::Sdf && !slot.spec_path.IsEmpty()) {
+        if (time.IsDefault()) {
+            _layer->SetField(slot.spec_path, pxr::SdfFieldKeys->Default, value);
+        } else {
+            _layer->SetTimeSample(slot.spec_path, time.GetValue(), value);
+        }
+        return;
+    }
+
+    slot.attr.Set(value, time);
+    if (slot.spec_path.IsEmpty() && _layer->HasSpec(slot.attr.GetPath())) {
+        slot.spec_path = slot.attr.GetPath();
+    }
+}
+
+void UsdRenderer::_flush_writes() {
+    // each shard is only touched by its own task; the stage is not written until they are all done
+    pxr::WorkParallelForN(_shards.size(), [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            pxr::SdfChangeBlock block;
+            for (const auto &write : _shard_writes[i]) {
+                _author(*write.slot, write.value, write.time);
+            }
+            _shard_writes[i].clear();
+        }
+    });
+
+    if (_pending_writes.empty()) {
+        return;
+    }
+
+    // Attributes without a spec yet are authored first, outside the change block,
+    // so that everything written inside the block is a plain value edit on an existing spec.
+    for (auto &write : _pending_writes) {
+        if (write.slot->spec_path.IsEmpty()) {
+            _author(*write.slot, write.value, write.time);
+            write.value = pxr::VtValue();
+        }
+    }
+
+    {
+        pxr::SdfChangeBlock block;
+        for (const auto &write : _pending_writes) {
+            if (!write.value.IsEmpty()) {
+                _author(*write.slot, write.value, write.time);
+            }
+        }
+    }
+    _pending_writes.clear();
+}
+
+UsdRenderer::~UsdRenderer() {
+    set_async(false);
+}
+
+void UsdRenderer::set_async(bool enabled, size_t max_queued_frames) {
+    if (_async) {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(_queue_mutex);
+            _writer_stop = true;
+        }
+        _queue_cv.notify_all();
+        _writer.join();
+        _async = false;
+    }
+
+    if (enabled) {
+        _max_queued_frames = std::max<size_t>(max_queued_frames, 1);
+        _writer_stop = false;
+        _async = true;
+        _writer = std::thread(&UsdRenderer::_writer_loop, this);
+    }
+}
+
+void UsdRenderer::flush() {
+    if (!_async) {
+        return;
+    }
+    if (!_capture.calls.empty()) {
+        _submit(std::move(_capture));
+        _capture = {};
+    }
+    wait_idle();
+}
+
+void UsdRenderer::wait_idle() {
+    if (!_async) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    _queue_cv.wait(lock, [this] { return _frame_queue.empty() && !_writer_busy; });
+}
+
+bool UsdRenderer::_is_deferring() const {
+    return _async && std::this_thread::get_id() != _writer.get_id();
+}
+
+bool UsdRenderer::_defer(std::function<void()> call) {
+    if (!_is_deferring()) {
+        return false;
+    }
+    _capture.calls.push_back(std::move(call));
+    return true;
+}
+
+void UsdRenderer::_submit(_CapturedFrame frame) {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    // backpressure: the simulation waits for the writer instead of queuing frames without bound
+    _queue_cv.wait(lock, [this] { return _frame_queue.size() < _max_queued_frames; });
+    _frame_queue.push_back(std::move(frame));
+    lock.unlock();
+    _queue_cv.notify_all();
+}
+
+void UsdRenderer::_writer_loop() {
+    while (true) {
+        _CapturedFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            _queue_cv.wait(lock, [this] { return !_frame_queue.empty() || _writer_stop; });
+            if (_frame_queue.empty()) {
+                return;
+            }
+            frame = std::move(_frame_queue.front());
+            _frame_queue.pop_front();
+            _writer_busy = true;
+        }
+        _queue_cv.notify_all();
+
+        if (frame.time.has_value()) {
+            begin_frame(frame.time.value());
+        }
+        for (auto &call : frame.calls) {
+            call();
+        }
+        if (frame.time.has_value()) {
+            end_frame();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_queue_mutex);
+            _writer_busy = false;
+        }
+        _queue_cv.notify_all();
+    }
+}
+
 void UsdRenderer::initialize(float scaling, UpAxis up_axis) {
+    _layer = _stage->GetRootLayer();
     _root = pxr::UsdGeomXform::Define(_stage, pxr::SdfPath("/root"));
 
     // apply scaling
@@ -60,6 +712,7 @@ void UsdRenderer::initialize(float scaling, UpAxis up_axis) {
     auto s = _root.AddScaleOp();
     s.Set(pxr::GfVec3f(scaling, scaling, scaling), 0);
 
+    _up_axis = up_axis;
     _stage->SetDefaultPrim(_root.GetPrim());
     _stage->SetStartTimeCode(0);
     _stage->SetEndTimeCode(0);
@@ -96,15 +749,46 @@ void UsdRenderer::initialize(float scaling, UpAxis up_axis) {
 }
 
 void UsdRenderer::begin_frame(float time) {
+    if (_async && std::this_thread::get_id() != _writer.get_id()) {
+        if (!_capture.calls.empty()) {
+            _submit(std::move(_capture));
+        }
+        _capture = {time, {}};
+        return;
+    }
+
     _stage->SetEndTimeCode(time * _fps);
     _time = time * _fps;
+    _in_frame = true;
+    if (_chunk_frames > 0 && !_chunk_start.has_value()) {
+        _chunk_start = _time;
+    }
 }
 
-void UsdRenderer::end_frame() {}
+void UsdRenderer::end_frame() {
+    if (_async && std::this_thread::get_id() != _writer.get_id()) {
+        _submit(std::move(_capture));
+        _capture = {};
+        return;
+    }
+
+    _flush_writes();
+    _in_frame = false;
+    if (_chunk_frames > 0 && ++_chunk_frame_count >= _chunk_frames) {
+        _flush_chunk();
+    }
+}
 
 void UsdRenderer::register_body(const pxr::TfToken &body_name) {
-    auto xform = pxr::UsdGeomXform::Define(_stage, _root.GetPath().AppendChild(body_name));
-    _usd_add_xform(xform);
+    if (_defer([=, this] { register_body(body_name); })) {
+        return;
+    }
+
+    auto body_path = _root.GetPath().AppendChild(body_name);
+    if (!_shards.empty() && _prims.find(body_path) == _prims.end()) {
+        _body_shards.emplace(body_path, int(_body_shards.size() % _shards.size()));
+    }
+    _get_or_define<pxr::UsdGeomXform>(body_path, true);
 }
 
 pxr::SdfPath UsdRenderer::_resolve_path(const pxr::TfToken &name,
@@ -123,24 +807,16 @@ pxr::SdfPath UsdRenderer::_resolve_path(const pxr::TfToken &name,
 // Render a plane with the given dimensions.
 pxr::SdfPath UsdRenderer::render_plane(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, float width, float length,
                                        const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath plane_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        plane_path = prim_path.AppendChild(pxr::TfToken{"plane"});
-    } else {
-        plane_path = _resolve_path(name, parent_body);
-        prim_path = plane_path;
+    if (_defer([=, this] { render_plane(name, pos, rot, width, length, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto plane = pxr::UsdGeomMesh::Get(_stage, plane_path);
-    // todo
-    {
-        plane = pxr::UsdGeomMesh::Define(_stage, plane_path);
+    auto [prim_path, plane_path] = _resolve_shape_paths(name, pxr::TfToken{"plane"}, parent_body, is_template);
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomMesh>(plane_path, true, &created);
+    if (created) {
+        auto plane = pxr::UsdGeomMesh(entry.prim);
         plane.CreateDoubleSidedAttr().Set(true);
         width = width > 0 ? width : 100.f;
         length = length > 0 ? length : 100.f;
@@ -154,18 +830,27 @@ pxr::SdfPath UsdRenderer::render_plane(const pxr::TfToken &name, pxr::GfVec3f po
         plane.GetNormalsAttr().Set(normals);
         plane.GetFaceVertexCountsAttr().Set(counts);
         plane.GetFaceVertexIndicesAttr().Set(indices);
-        _usd_add_xform(plane);
     }
 
     if (!is_template) {
-        _usd_set_xform(plane, pos, rot, pxr::GfVec3f{1, 1, 1}, 0);
+        _set_xform(entry, pos, rot, pxr::GfVec3f{1, 1, 1}, 0);
     }
 
     return prim_path;
 }
 
 void UsdRenderer::render_ground(float size) {
-    auto mesh = pxr::UsdGeomMesh::Define(_stage, _root.GetPath().AppendChild(pxr::TfToken{"ground"}));
+    if (_defer([=, this] { render_ground(size); })) {
+        return;
+    }
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomMesh>(_root.GetPath().AppendChild(pxr::TfToken{"ground"}), false, &created);
+    if (!created) {
+        return;
+    }
+
+    auto mesh = pxr::UsdGeomMesh(entry.prim);
     mesh.CreateDoubleSidedAttr().Set(true);
 
     pxr::VtVec3fArray points;
@@ -199,31 +884,18 @@ void UsdRenderer::render_ground(float size) {
 /// Debug helper to add a sphere for visualization
 pxr::SdfPath UsdRenderer::render_sphere(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, float radius,
                                         const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath sphere_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        sphere_path = prim_path.AppendChild(pxr::TfToken{"sphere"});
-    } else {
-        sphere_path = _resolve_path(name, parent_body);
-        prim_path = sphere_path;
+    if (_defer([=, this] { render_sphere(name, pos, rot, radius, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto sphere = pxr::UsdGeomSphere::Get(_stage, sphere_path);
-    // todo
-    {
-        sphere = pxr::UsdGeomSphere::Define(_stage, sphere_path);
-        _usd_add_xform(sphere);
-    }
+    auto [prim_path, sphere_path] = _resolve_shape_paths(name, pxr::TfToken{"sphere"}, parent_body, is_template);
+
+    auto &entry = _get_or_define<pxr::UsdGeomSphere>(sphere_path, true);
 
-    sphere.GetRadiusAttr().Set(radius, _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->radius), pxr::VtValue(double(radius)), _time);
 
     if (!is_template) {
-        _usd_set_xform(sphere, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0);
+        _set_xform(entry, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0);
     }
     return prim_path;
 }
@@ -231,33 +903,23 @@ pxr::SdfPath UsdRenderer::render_sphere(const pxr::TfToken &name, pxr::GfVec3f p
 /// Debug helper to add a capsule for visualization
 pxr::SdfPath UsdRenderer::render_capsule(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, float radius, float half_height,
                                          const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath capsule_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        capsule_path = prim_path.AppendChild(pxr::TfToken{"capsule"});
-    } else {
-        capsule_path = _resolve_path(name, parent_body);
-        prim_path = capsule_path;
+    if (_defer([=, this] { render_capsule(name, pos, rot, radius, half_height, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto capsule = pxr::UsdGeomCapsule::Get(_stage, capsule_path);
-    // todo
-    {
-        capsule = pxr::UsdGeomCapsule::Define(_stage, capsule_path);
-        _usd_add_xform(capsule);
+    auto [prim_path, capsule_path] = _resolve_shape_paths(name, pxr::TfToken{"capsule"}, parent_body, is_template);
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomCapsule>(capsule_path, true, &created);
+    if (created) {
+        pxr::UsdGeomCapsule(entry.prim).GetAxisAttr().Set(pxr::UsdGeomTokens->y);
     }
 
-    capsule.GetRadiusAttr().Set(radius);
-    capsule.GetHeightAttr().Set(half_height * 2.f);
-    capsule.GetAxisAttr().Set("Y");
+    _write(_attr(entry, pxr::UsdGeomTokens->radius), pxr::VtValue(double(radius)));
+    _write(_attr(entry, pxr::UsdGeomTokens->height), pxr::VtValue(double(half_height * 2.f)));
 
     if (!is_template) {
-        _usd_set_xform(capsule, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
+        _set_xform(entry, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
     }
     return prim_path;
 }
@@ -265,33 +927,23 @@ pxr::SdfPath UsdRenderer::render_capsule(const pxr::TfToken &name, pxr::GfVec3f
 // Debug helper to add a cylinder for visualization
 pxr::SdfPath UsdRenderer::render_cylinder(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, float radius, float half_height,
                                           const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath cylinder_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        cylinder_path = prim_path.AppendChild(pxr::TfToken{"cylinder"});
-    } else {
-        cylinder_path = _resolve_path(name, parent_body);
-        prim_path = cylinder_path;
+    if (_defer([=, this] { render_cylinder(name, pos, rot, radius, half_height, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto cylinder = pxr::UsdGeomCylinder::Get(_stage, cylinder_path);
-    // todo
-    {
-        cylinder = pxr::UsdGeomCylinder::Define(_stage, cylinder_path);
-        _usd_add_xform(cylinder);
+    auto [prim_path, cylinder_path] = _resolve_shape_paths(name, pxr::TfToken{"cylinder"}, parent_body, is_template);
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomCylinder>(cylinder_path, true, &created);
+    if (created) {
+        pxr::UsdGeomCylinder(entry.prim).GetAxisAttr().Set(pxr::UsdGeomTokens->y);
     }
 
-    cylinder.GetRadiusAttr().Set(radius);
-    cylinder.GetHeightAttr().Set(half_height * 2.f);
-    cylinder.GetAxisAttr().Set("Y");
+    _write(_attr(entry, pxr::UsdGeomTokens->radius), pxr::VtValue(double(radius)));
+    _write(_attr(entry, pxr::UsdGeomTokens->height), pxr::VtValue(double(half_height * 2.f)));
 
     if (!is_template) {
-        _usd_set_xform(cylinder, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
+        _set_xform(entry, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
     }
     return prim_path;
 }
@@ -299,33 +951,23 @@ pxr::SdfPath UsdRenderer::render_cylinder(const pxr::TfToken &name, pxr::GfVec3f
 // Debug helper to add a cone for visualization
 pxr::SdfPath UsdRenderer::render_cone(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, float radius, float half_height,
                                       const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath cone_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        cone_path = prim_path.AppendChild(pxr::TfToken{"cone"});
-    } else {
-        cone_path = _resolve_path(name, parent_body);
-        prim_path = cone_path;
+    if (_defer([=, this] { render_cone(name, pos, rot, radius, half_height, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto cone = pxr::UsdGeomCone::Get(_stage, cone_path);
-    // todo
-    {
-        cone = pxr::UsdGeomCone::Define(_stage, cone_path);
-        _usd_add_xform(cone);
+    auto [prim_path, cone_path] = _resolve_shape_paths(name, pxr::TfToken{"cone"}, parent_body, is_template);
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomCone>(cone_path, true, &created);
+    if (created) {
+        pxr::UsdGeomCone(entry.prim).GetAxisAttr().Set(pxr::UsdGeomTokens->y);
     }
 
-    cone.GetRadiusAttr().Set(radius);
-    cone.GetHeightAttr().Set(half_height * 2.f);
-    cone.GetAxisAttr().Set("Y");
+    _write(_attr(entry, pxr::UsdGeomTokens->radius), pxr::VtValue(double(radius)));
+    _write(_attr(entry, pxr::UsdGeomTokens->height), pxr::VtValue(double(half_height * 2.f)));
 
     if (!is_template) {
-        _usd_set_xform(cone, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
+        _set_xform(entry, pos, rot, pxr::GfVec3f{1.f, 1.f, 1.f}, 0.f);
     }
     return prim_path;
 }
@@ -333,46 +975,134 @@ pxr::SdfPath UsdRenderer::render_cone(const pxr::TfToken &name, pxr::GfVec3f pos
 // Debug helper to add a box for visualization
 pxr::SdfPath UsdRenderer::render_box(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f extents,
                                      const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath cube_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        cube_path = prim_path.AppendChild(pxr::TfToken{"cube"});
-    } else {
-        cube_path = _resolve_path(name, parent_body);
-        prim_path = cube_path;
+    if (_defer([=, this] { render_box(name, pos, rot, extents, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto cube = pxr::UsdGeomCube::Get(_stage, cube_path);
-    // todo
-    {
-        cube = pxr::UsdGeomCube::Define(_stage, cube_path);
-        _usd_add_xform(cube);
-    }
+    auto [prim_path, cube_path] = _resolve_shape_paths(name, pxr::TfToken{"cube"}, parent_body, is_template);
+
+    auto &entry = _get_or_define<pxr::UsdGeomCube>(cube_path, true);
 
     if (!is_template) {
-        _usd_set_xform(cube, pos, rot, extents, 0.f);
+        _set_xform(entry, pos, rot, extents, 0.f);
     }
     return prim_path;
 }
 
+pxr::SdfPath UsdRenderer::_render_instances(const pxr::TfToken &name, const pxr::SdfPath &prototype,
+                                            const pxr::VtVec3fArray &positions, const pxr::VtQuatfArray &orientations,
+                                            const std::optional<pxr::VtVec3fArray> &scales) {
+    auto instancer_path = _resolve_path(name);
+    if (orientations.size() != positions.size() || (scales.has_value() && scales->size() != positions.size())) {
+        LOGE("instance arrays of {} have mismatched sizes", instancer_path.GetString());
+        return instancer_path;
+    }
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomPointInstancer>(instancer_path, false, &created);
+    if (created) {
+        pxr::UsdGeomPointInstancer(entry.prim).CreatePrototypesRel().SetTargets({prototype});
+    }
+
+    // every instance uses the single prototype, so the indices only change with the instance count
+    if (created || entry.instance_count != positions.size()) {
+        entry.instance_count = positions.size();
+        _write(_attr(entry, pxr::UsdGeomTokens->protoIndices), pxr::VtValue(pxr::VtIntArray(positions.size(), 0)), _time);
+    }
+
+    pxr::VtQuathArray orientations_h(orientations.size());
+    for (size_t i = 0; i < orientations.size(); ++i) {
+        orientations_h[i] = pxr::GfQuath(orientations[i]);
+    }
+
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->positions), pxr::VtValue(positions), _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->orientations), pxr::VtValue::Take(orientations_h), _time);
+    if (scales.has_value()) {
+        _write_sample(_attr(entry, pxr::UsdGeomTokens->scales), pxr::VtValue(scales.value()), _time);
+    }
+    return instancer_path;
+}
+
+pxr::SdfPath UsdRenderer::render_spheres(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                         const pxr::VtQuatfArray &orientations, const pxr::VtFloatArray &radii) {
+    if (_defer([=, this] { render_spheres(name, positions, orientations, radii); })) {
+        return _resolve_path(name);
+    }
+
+    // unit sphere prototype, the radius of each instance is carried by its scale
+    auto prototype = _resolve_path(name, std::nullopt, true);
+    if (_prims.find(prototype) == _prims.end()) {
+        render_sphere(name, {}, {}, 1.f, std::nullopt, true);
+    }
+
+    pxr::VtVec3fArray scales(radii.size());
+    for (size_t i = 0; i < radii.size(); ++i) {
+        scales[i] = pxr::GfVec3f(radii[i]);
+    }
+    return _render_instances(name, prototype, positions, orientations, scales);
+}
+
+pxr::SdfPath UsdRenderer::render_boxes(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                       const pxr::VtQuatfArray &orientations, const pxr::VtVec3fArray &extents) {
+    if (_defer([=, this] { render_boxes(name, positions, orientations, extents); })) {
+        return _resolve_path(name);
+    }
+
+    // unit cube prototype, scaled by the extents as in render_box
+    auto prototype = _resolve_path(name, std::nullopt, true);
+    if (_prims.find(prototype) == _prims.end()) {
+        render_box(name, {}, {}, {1.f, 1.f, 1.f}, std::nullopt, true);
+    }
+    return _render_instances(name, prototype, positions, orientations, extents);
+}
+
+// Capsules, cylinders and cones cannot be scaled without distorting them, so all instances share the dimensions of
+// the prototype, which are updated on every call
+pxr::SdfPath UsdRenderer::render_capsules(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                          const pxr::VtQuatfArray &orientations, float radius, float half_height) {
+    if (_defer([=, this] { render_capsules(name, positions, orientations, radius, half_height); })) {
+        return _resolve_path(name);
+    }
+
+    auto prototype = render_capsule(name, {}, {}, radius, half_height, std::nullopt, true);
+    return _render_instances(name, prototype, positions, orientations, std::nullopt);
+}
+
+pxr::SdfPath UsdRenderer::render_cylinders(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                           const pxr::VtQuatfArray &orientations, float radius, float half_height) {
+    if (_defer([=, this] { render_cylinders(name, positions, orientations, radius, half_height); })) {
+        return _resolve_path(name);
+    }
+
+    auto prototype = render_cylinder(name, {}, {}, radius, half_height, std::nullopt, true);
+    return _render_instances(name, prototype, positions, orientations, std::nullopt);
+}
+
+pxr::SdfPath UsdRenderer::render_cones(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                       const pxr::VtQuatfArray &orientations, float radius, float half_height) {
+    if (_defer([=, this] { render_cones(name, positions, orientations, radius, half_height); })) {
+        return _resolve_path(name);
+    }
+
+    auto prototype = render_cone(name, {}, {}, radius, half_height, std::nullopt, true);
+    return _render_instances(name, prototype, positions, orientations, std::nullopt);
+}
+
 void UsdRenderer::render_ref(const std::string &name, const pxr::TfToken &path,
                              pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f scale) {
+    if (_defer([=, this] { render_ref(name, path, pos, rot, scale); })) {
+        return;
+    }
+
     auto ref_path = pxr::SdfPath("/root/" + name);
-    auto ref = pxr::UsdGeomXform::Get(_stage, ref_path);
-    // todo
-    {
-        ref = pxr::UsdGeomXform::Define(_stage, ref_path);
-        ref.GetPrim().GetReferences().AddReference(path);
-        _usd_add_xform(ref);
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomXform>(ref_path, true, &created);
+    if (created) {
+        entry.prim.GetReferences().AddReference(path);
     }
 
     // update transform
-    _usd_set_xform(ref, pos, rot, scale, _time);
+    _set_xform(entry, pos, rot, scale, _time);
 }
 
 pxr::SdfPath UsdRenderer::render_mesh(const pxr::TfToken &name, const pxr::VtVec3fArray &points, const pxr::VtIntArray &indices,
@@ -380,53 +1110,80 @@ pxr::SdfPath UsdRenderer::render_mesh(const pxr::TfToken &name, const pxr::VtVec
                                       pxr::GfVec3f pos, pxr::GfQuatf rot,
                                       pxr::GfVec3f scale, bool update_topology,
                                       const std::optional<pxr::TfToken> &parent_body, bool is_template) {
-    pxr::SdfPath prim_path;
-    pxr::SdfPath mesh_path;
-    if (is_template) {
-        prim_path = _resolve_path(name, parent_body, is_template);
-        auto blueprint = pxr::UsdGeomScope::Define(_stage, prim_path);
-        auto blueprint_prim = blueprint.GetPrim();
-        blueprint_prim.SetInstanceable(true);
-        blueprint_prim.SetSpecifier(pxr::SdfSpecifierClass);
-        mesh_path = prim_path.AppendChild(pxr::TfToken{"mesh"});
-    } else {
-        mesh_path = _resolve_path(name, parent_body);
-        prim_path = mesh_path;
+    if (_defer([=, this] { render_mesh(name, points, indices, color, pos, rot, scale, update_topology, parent_body, is_template); })) {
+        return _resolve_path(name, parent_body, is_template);
     }
 
-    auto mesh = pxr::UsdGeomMesh::Get(_stage, mesh_path);
-    // todo
-    {
-        mesh = pxr::UsdGeomMesh::Define(_stage, mesh_path);
-        pxr::UsdGeomPrimvar(mesh.GetDisplayColorAttr()).SetInterpolation(pxr::TfToken("vertex"));
-        _usd_add_xform(mesh);
+    auto [prim_path, mesh_path] = _resolve_shape_paths(name, pxr::TfToken{"mesh"}, parent_body, is_template);
+    if ((update_topology || !_prims.contains(mesh_path)) && !_valid_triangles(indices, points.size())) {
+        LOGE("indices of mesh {} are not a triangle list within its {} points", mesh_path.GetString(), points.size());
+        return prim_path;
+    }
+
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomMesh>(mesh_path, true, &created);
+    if (created) {
+        pxr::UsdGeomPrimvar(pxr::UsdGeomMesh(entry.prim).GetDisplayColorAttr()).SetInterpolation(pxr::UsdGeomTokens->vertex);
 
         // force topology update on first time
         update_topology = true;
     }
 
-    mesh.GetPointsAttr().Set(points, _time);
+    auto &points_slot = _attr(entry, pxr::UsdGeomTokens->points);
+    if (_skip_unchanged_points) {
+        _write_if_changed(points_slot, pxr::VtValue(points), _content_hash(points), _time);
+    } else {
+        _write(points_slot, pxr::VtValue(points), _time);
+    }
 
     if (update_topology) {
-        // todo
-        //            idxs = np.array(indices).reshape(-1, 3)
-        //            mesh.GetFaceVertexIndicesAttr().Set(idxs, self.time)
-        //            mesh.GetFaceVertexCountsAttr().Set([3] * len(idxs), self.time)
+        // indices form a triangle list; unchanged topology is never authored again
+        const auto num_faces = indices.size() / 3;
+        _write_topology(_attr(entry, pxr::UsdGeomTokens->faceVertexCounts), pxr::VtValue(pxr::VtIntArray(num_faces, 3)),
+                        num_faces);
+        _write_topology(_attr(entry, pxr::UsdGeomTokens->faceVertexIndices), pxr::VtValue(indices),
+                        _content_hash(indices));
     }
 
     if (color.has_value()) {
-        mesh.GetDisplayColorAttr().Set(color.value(), _time);
+        _write_sample(_attr(entry, pxr::UsdGeomTokens->primvarsDisplayColor), pxr::VtValue(color.value()), _time);
     }
 
     if (!is_template) {
-        _usd_set_xform(mesh, pos, rot, scale, _time);
+        _set_xform(entry, pos, rot, scale, _time);
     }
     return prim_path;
 }
 
+pxr::SdfPath UsdRenderer::render_mesh(const pxr::TfToken &name, std::span<const pxr::GfVec3f> points, std::span<const int> indices,
+                                      std::shared_ptr<const void> owner,
+                                      const std::optional<pxr::VtVec3fArray> &color,
+                                      pxr::GfVec3f pos, pxr::GfQuatf rot,
+                                      pxr::GfVec3f scale, bool update_topology,
+                                      const std::optional<pxr::TfToken> &parent_body, bool is_template) {
+    return render_mesh(name, make_vt_array(points, owner), make_vt_array(indices, owner), color, pos, rot, scale,
+                       update_topology, parent_body, is_template);
+}
+
 // Debug helper to add a line list as a set of capsules
 void UsdRenderer::render_line_list(const pxr::TfToken &name, const pxr::VtVec3fArray &vertices,
                                    const pxr::VtIntArray &indices, pxr::GfVec3f color, float radius) {
+    if (_defer([=, this] { render_line_list(name, vertices, indices, color, radius); })) {
+        return;
+    }
+
+    render_line_list(name, std::span<const pxr::GfVec3f>{vertices.cdata(), vertices.size()},
+                     std::span<const int>{indices.cdata(), indices.size()}, color, radius);
+}
+
+void UsdRenderer::render_line_list(const pxr::TfToken &name, std::span<const pxr::GfVec3f> vertices,
+                                   std::span<const int> indices, pxr::GfVec3f color, float radius) {
+    if (_is_deferring()) {
+        // the caller may reuse the buffers before the writer thread runs
+        render_line_list(name, make_vt_array(vertices), make_vt_array(indices), color, radius);
+        return;
+    }
+
     auto num_lines = int(indices.size() / 2);
     if (num_lines < 1) {
         return;
@@ -434,109 +1191,126 @@ void UsdRenderer::render_line_list(const pxr::TfToken &name, const pxr::VtVec3fA
 
     // look up rope point instancer
     auto instancer_path = _root.GetPath().AppendChild(name);
-    auto instancer = pxr::UsdGeomPointInstancer::Get(_stage, instancer_path);
-    // todo
-    {
-        instancer = pxr::UsdGeomPointInstancer::Define(_stage, instancer_path);
-        auto instancer_capsule = pxr::UsdGeomCapsule::Define(_stage,
-                                                             instancer.GetPath().AppendChild(pxr::TfToken("capsule")));
-        instancer_capsule.GetRadiusAttr().Set(radius);
-        instancer.CreatePrototypesRel().SetTargets({instancer_capsule.GetPath()});
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomPointInstancer>(instancer_path, false, &created);
+    auto instancer = pxr::UsdGeomPointInstancer(entry.prim);
+    if (created) {
+        auto &capsule = _get_or_define<pxr::UsdGeomCapsule>(instancer_path.AppendChild(pxr::TfToken("capsule")), false);
+        pxr::UsdGeomCapsule(capsule.prim).GetRadiusAttr().Set(double(radius));
+        instancer.CreatePrototypesRel().SetTargets({capsule.prim.GetPath()});
     }
 
-    pxr::VtVec3fArray line_positions;
-    pxr::VtQuatfArray line_rotations;
-    pxr::VtVec3fArray line_scales;
-    for (int i = 0; i < num_lines; ++i) {
-        auto pos0 = vertices[indices[i * 2 + 0]];
-        auto pos1 = vertices[indices[i * 2 + 1]];
-        auto [pos, rot, scale] = _compute_segment_xform(
-            pxr::GfVec3f(float(pos0[0]), float(pos0[1]), float(pos0[2])),
-            pxr::GfVec3f(float(pos1[0]), float(pos1[1]), float(pos1[2])));
+    SegmentXforms xforms;
+    compute_segment_xforms(vertices, indices, xforms);
 
-        line_positions.push_back(pos);
-        line_rotations.push_back(rot);
-        line_scales.push_back(scale);
+    if (entry.instance_count != size_t(num_lines)) {
+        entry.instance_count = num_lines;
+        _write(_attr(entry, pxr::UsdGeomTokens->protoIndices), pxr::VtValue(pxr::VtIntArray(num_lines, 0)), _time);
     }
-
-    instancer.GetPositionsAttr().Set(line_positions, _time);
-    instancer.GetOrientationsAttr().Set(line_rotations, _time);
-    instancer.GetScalesAttr().Set(line_scales, _time);
-    // todo
-    //                instancer.GetProtoIndicesAttr().Set([0] * num_lines, _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->positions), pxr::VtValue::Take(xforms.positions), _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->orientations), pxr::VtValue::Take(xforms.orientations), _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->scales), pxr::VtValue::Take(xforms.scales), _time);
 }
 
 void UsdRenderer::render_line_strip(const pxr::TfToken &name, const pxr::VtVec3fArray &vertices,
                                     pxr::GfVec3f color, float radius) {
+    if (_defer([=, this] { render_line_strip(name, vertices, color, radius); })) {
+        return;
+    }
+
+    render_line_strip(name, std::span<const pxr::GfVec3f>{vertices.cdata(), vertices.size()}, color, radius);
+}
+
+void UsdRenderer::render_line_strip(const pxr::TfToken &name, std::span<const pxr::GfVec3f> vertices,
+                                    pxr::GfVec3f color, float radius) {
+    if (_is_deferring()) {
+        render_line_strip(name, make_vt_array(vertices), color, radius);
+        return;
+    }
+
     auto num_lines = int(vertices.size() - 1);
     if (num_lines < 1) {
         return;
     }
 
     auto instancer_path = _root.GetPath().AppendChild(name);
-    auto instancer = pxr::UsdGeomPointInstancer::Get(_stage, instancer_path);
-    // todo
-    {
-        instancer = pxr::UsdGeomPointInstancer::Define(_stage, instancer_path);
-        auto instancer_capsule = pxr::UsdGeomCapsule::Define(_stage, instancer.GetPath().AppendChild(pxr::TfToken("capsule")));
-        instancer_capsule.GetRadiusAttr().Set(radius);
-        instancer.CreatePrototypesRel().SetTargets({instancer_capsule.GetPath()});
+    auto capsule_path = instancer_path.AppendChild(pxr::TfToken("capsule"));
+    bool created;
+    auto &entry = _get_or_define<pxr::UsdGeomPointInstancer>(instancer_path, false, &created);
+    auto instancer = pxr::UsdGeomPointInstancer(entry.prim);
+    auto &capsule = _get_or_define<pxr::UsdGeomCapsule>(capsule_path, false);
+    if (created) {
+        pxr::UsdGeomCapsule(capsule.prim).GetRadiusAttr().Set(double(radius));
+        instancer.CreatePrototypesRel().SetTargets({capsule_path});
     }
 
-    pxr::VtVec3fArray line_positions;
-    pxr::VtQuatfArray line_rotations;
-    pxr::VtVec3fArray line_scales;
-    for (int i = 0; i < num_lines; ++i) {
-        auto pos0 = vertices[i];
-        auto pos1 = vertices[i + 1];
-        auto [pos, rot, scale] = _compute_segment_xform(
-            pxr::GfVec3f(float(pos0[0]), float(pos0[1]), float(pos0[2])),
-            pxr::GfVec3f(float(pos1[0]), float(pos1[1]), float(pos1[2])));
+    SegmentXforms xforms;
+    compute_segment_xforms(vertices, xforms);
 
-        line_positions.push_back(pos);
-        line_rotations.push_back(rot);
-        line_scales.push_back(scale);
+    if (entry.instance_count != size_t(num_lines)) {
+        entry.instance_count = num_lines;
+        _write(_attr(entry, pxr::UsdGeomTokens->protoIndices), pxr::VtValue(pxr::VtIntArray(num_lines, 0)), _time);
     }
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->positions), pxr::VtValue::Take(xforms.positions), _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->orientations), pxr::VtValue::Take(xforms.orientations), _time);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->scales), pxr::VtValue::Take(xforms.scales), _time);
 
-    instancer.GetPositionsAttr().Set(line_positions, _time);
-    instancer.GetOrientationsAttr().Set(line_rotations, _time);
-    instancer.GetScalesAttr().Set(line_scales, _time);
-    // todo
-    //        instancer.GetProtoIndicesAttr().Set([0] * num_lines, _time);
+    _write_sample(_attr(capsule, pxr::UsdGeomTokens->primvarsDisplayColor), pxr::VtValue(pxr::VtVec3fArray{color}), _time);
+}
 
-    auto instancer_capsule = pxr::UsdGeomCapsule::Get(_stage, instancer.GetPath().AppendChild(pxr::TfToken{"capsule"}));
-    instancer_capsule.GetDisplayColorAttr().Set(pxr::VtVec3fArray{pxr::GfVec3f(color)}, _time);
+UsdRenderer::_PrimEntry &UsdRenderer::_render_points(const pxr::TfToken &name, const pxr::VtVec3fArray &points) {
+    auto &entry = _get_or_define<pxr::UsdGeomPoints>(_root.GetPath().AppendChild(name), false);
+    _write_sample(_attr(entry, pxr::UsdGeomTokens->points), pxr::VtValue(points), _time);
+    return entry;
 }
 
 void UsdRenderer::render_point(const pxr::TfToken &name, const pxr::VtVec3fArray &points,
                                float radius, std::optional<pxr::GfVec3f> color) {
-    auto instancer_path = _root.GetPath().AppendChild(name);
-    auto instancer = pxr::UsdGeomPointInstancer::Get(_stage, instancer_path);
-    // todo
-    {
-        if (!color.has_value()) {
-            instancer = pxr::UsdGeomPointInstancer::Define(_stage, instancer_path);
-            auto instancer_sphere = pxr::UsdGeomSphere::Define(_stage, instancer.GetPath().AppendChild(pxr::TfToken{"sphere"}));
+    if (_defer([=, this] { render_point(name, points, radius, color); })) {
+        return;
+    }
 
-            instancer_sphere.GetRadiusAttr().Set(radius);
+    auto &entry = _render_points(name, points);
 
-            instancer.CreatePrototypesRel().SetTargets({instancer_sphere.GetPath()});
-            // todo
-            //                instancer.CreateProtoIndicesAttr().Set();
+    auto &widths = _attr(entry, pxr::UsdGeomTokens->widths);
+    _set_interpolation(widths, pxr::UsdGeomTokens->constant);
+    _write_sample(widths, pxr::VtValue(pxr::VtFloatArray{radius * 2.f}), _time);
 
-            //                auto quat
-            //                    instancer.GetOrientationsAttr().Set(quats, _time);
-        } else {
-            auto instancer = pxr::UsdGeomPoints::Define(_stage, instancer_path);
-            instancer.GetWidthsAttr().Set(pxr::VtFloatArray(points.size(), radius));
-        }
+    if (color.has_value()) {
+        auto &display_color = _attr(entry, pxr::UsdGeomTokens->primvarsDisplayColor);
+        _set_interpolation(display_color, pxr::UsdGeomTokens->constant);
+        _write_sample(display_color, pxr::VtValue(pxr::VtVec3fArray{color.value()}), _time);
     }
+}
+
+void UsdRenderer::render_point(const pxr::TfToken &name, const pxr::VtVec3fArray &points, const pxr::VtFloatArray &widths,
+                               const std::optional<pxr::VtVec3fArray> &colors) {
+    if (_defer([=, this] { render_point(name, points, widths, colors); })) {
+        return;
+    }
+
+    if (widths.size() != points.size() || (colors.has_value() && colors->size() != points.size())) {
+        LOGE("point arrays of {} have mismatched sizes", name.GetString());
+        return;
+    }
+
+    auto &entry = _render_points(name, points);
+
+    auto &widths_slot = _attr(entry, pxr::UsdGeomTokens->widths);
+    _set_interpolation(widths_slot, pxr::UsdGeomTokens->vertex);
+    _write_sample(widths_slot, pxr::VtValue(widths), _time);
+
+    if (colors.has_value()) {
+        auto &display_color = _attr(entry, pxr::UsdGeomTokens->primvarsDisplayColor);
+        _set_interpolation(display_color, pxr::UsdGeomTokens->vertex);
+        _write_sample(display_color, pxr::VtValue(colors.value()), _time);
+    }
+}
 
-    //        if colors is None:
-    //            instancer.GetPositionsAttr().Set(points, self.time)
-    //        else:
-    //            instancer.GetPointsAttr().Set(points, self.time)
-    //            instancer.GetDisplayColorAttr().Set(colors, self.time)
+void UsdRenderer::render_point(const pxr::TfToken &name, std::span<const pxr::GfVec3f> points,
+                               float radius, std::optional<pxr::GfVec3f> color,
+                               std::shared_ptr<const void> owner) {
+    render_point(name, make_vt_array(points, std::move(owner)), radius, color);
 }
 
-}// namespace vox
\ No newline at end of file
+}// namespace vox
@@ -6,11 +6,24 @@
 
 #pragma once
 
+#include "usd_foreign_array.h"
+
 #include <pxr/pxr.h>
+#include <pxr/usd/sdf/assetPath.h>
 #include <pxr/usd/usd/prim.h>
 #include <pxr/usd/usdGeom/xform.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace vox {
 enum class UpAxis {
@@ -19,6 +32,42 @@ enum class UpAxis {
     Z,
 };
 
+/// How the writes buffered between begin_frame and end_frame are committed.
+enum class FlushMode {
+    /// Author through UsdAttribute::Set
+    Usd,
+    /// Once an attribute has been authored, stream its samples directly to the root layer spec
+    Sdf,
+};
+
+/// Storage precision of the transforms authored by the renderer.
+enum class Precision {
+    Float,
+    /// translate, orient and scale ops as half3 / quath
+    Half,
+};
+
+/// Maximum absolute error, per component, introduced by the storage precision since it was set.
+struct PrecisionReport {
+    float max_translate_error{0};
+    float max_orient_error{0};
+    float max_scale_error{0};
+};
+
+/// Values authored by a renderer: time samples and defaults, with the payload size of their data.
+struct WriteStats {
+    size_t values{0};
+    size_t bytes{0};
+};
+
+/// Where the shard layers of a sharded renderer go on finalize.
+enum class ShardOutput {
+    /// Copy the shard opinions into the root layer
+    Merge,
+    /// Export each shard next to the root layer and add it as a sublayer
+    Sublayers,
+};
+
 class UsdRenderer {
 public:
     explicit UsdRenderer(pxr::UsdStageRefPtr stage, UpAxis up_axis = UpAxis::Y, float fps = 60, float scaling = 1.0)
@@ -33,12 +82,68 @@ public:
         initialize(scaling, up_axis);
     }
 
+    ~UsdRenderer();
+
     void initialize(float scaling, UpAxis up_axis);
 
+    /// Open a frame: attribute writes are buffered until end_frame.
     void begin_frame(float time);
 
+    /// Flush the buffered writes of the frame inside a single SdfChangeBlock.
     void end_frame();
 
+    /// Waits for the submitted frames, the writer thread reads the mode.
+    void set_flush_mode(FlushMode mode);
+
+    /// Samples of transforms, instancer arrays and colors within epsilon of the last written sample are skipped.
+    /// Waits for the submitted frames, the writer thread compares against it.
+    void set_change_epsilon(float epsilon);
+
+    /// Select the precision of the xform ops of the prims defined afterwards. Array attributes keep the types of
+    /// their schema, point instancer orientations being quath in both modes. Waits for the submitted frames.
+    void set_precision(Precision precision);
+
+    /// Waits for the submitted frames, the writer thread updates the report while it authors the transforms.
+    [[nodiscard]] PrecisionReport precision_report();
+
+    [[nodiscard]] WriteStats write_stats() const { return {_values_written.load(), _bytes_written.load()}; }
+
+    /// Skip the points sample of render_mesh when the points are identical to the previous sample of the mesh.
+    /// Waits for the submitted frames, the writer thread reads the setting.
+    void set_skip_unchanged_points(bool skip);
+
+    /// In asynchronous mode the render calls of a frame are captured on the calling thread and authored by a
+    /// dedicated writer thread. end_frame blocks while max_queued_frames frames are waiting to be written.
+    /// The stage must not be accessed from other threads until wait_idle returns.
+    void set_async(bool enabled, size_t max_queued_frames = 2);
+
+    /// Submit the calls captured outside of a frame and wait until the writer thread is idle.
+    void flush();
+
+    /// Block until every submitted frame has been authored.
+    void wait_idle();
+
+    /// Chunked recording: every frames_per_chunk frames the time samples written so far are moved from the root
+    /// layer to a usdc clip layer <clip_prefix>.<index>.usdc, saved and released, and the clip is registered on
+    /// /root with UsdClipsAPI. clip_prefix defaults to the root layer path without extension; it is required for
+    /// in-memory stages. Passing 0 disables chunking.
+    void set_chunked(size_t frames_per_chunk, const std::string &clip_prefix = {});
+
+    /// Sharded mode: the attributes of the bodies registered afterwards are partitioned round-robin across
+    /// num_shards anonymous layers, and end_frame authors the shards in parallel. Prim definitions stay on the root
+    /// layer. The shards are not part of the stage while recording, so the stage only sees their values after
+    /// finalize, which merges them or composes them as sublayers depending on output.
+    void set_sharded(size_t num_shards, ShardOutput output = ShardOutput::Merge);
+
+    /// Collapse the change-tracked attributes holding a single sample into a default value.
+    /// In chunked mode the pending chunk is written instead, the samples being already in clips.
+    /// The shard layers are then merged or composed.
+    /// Must be called outside of a frame; recording may continue afterwards.
+    void finalize();
+
+    /// Finalize and save the stage.
+    void save();
+
     void register_body(const pxr::TfToken &body_name);
 
     pxr::SdfPath _resolve_path(const pxr::TfToken &name,
@@ -71,6 +176,23 @@ public:
     pxr::SdfPath render_box(const pxr::TfToken &name, pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f extents,
                             const std::optional<pxr::TfToken> &parent_body = std::nullopt, bool is_template = false);
 
+    /// Batched variants: one point instancer per call, using the template shape `_template_shapes/<name>` as prototype.
+    /// positions and orientations hold one entry per instance.
+    pxr::SdfPath render_spheres(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                const pxr::VtQuatfArray &orientations, const pxr::VtFloatArray &radii);
+
+    pxr::SdfPath render_boxes(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                              const pxr::VtQuatfArray &orientations, const pxr::VtVec3fArray &extents);
+
+    pxr::SdfPath render_capsules(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                 const pxr::VtQuatfArray &orientations, float radius, float half_height);
+
+    pxr::SdfPath render_cylinders(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                                  const pxr::VtQuatfArray &orientations, float radius, float half_height);
+
+    pxr::SdfPath render_cones(const pxr::TfToken &name, const pxr::VtVec3fArray &positions,
+                              const pxr::VtQuatfArray &orientations, float radius, float half_height);
+
     void render_ref(const std::string &name, const pxr::TfToken &path,
                     pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f scale);
 
@@ -80,23 +202,212 @@ public:
                              pxr::GfVec3f scale = {1, 1, 1}, bool update_topology = false,
                              const std::optional<pxr::TfToken> &parent_body = std::nullopt, bool is_template = false);
 
+    /// Variant taking caller buffers (a pointer and a count convert to std::span). The buffers are wrapped without
+    /// copy when owner is given and copied otherwise, see make_vt_array for the lifetime rules.
+    pxr::SdfPath render_mesh(const pxr::TfToken &name, std::span<const pxr::GfVec3f> points, std::span<const int> indices,
+                             std::shared_ptr<const void> owner = nullptr,
+                             const std::optional<pxr::VtVec3fArray> &color = std::nullopt,
+                             pxr::GfVec3f pos = {0, 0, 0}, pxr::GfQuatf rot = {0, 0, 0, 1},
+                             pxr::GfVec3f scale = {1, 1, 1}, bool update_topology = false,
+                             const std::optional<pxr::TfToken> &parent_body = std::nullopt, bool is_template = false);
+
     // Debug helper to add a line list as a set of capsules
     void render_line_list(const pxr::TfToken &name, const pxr::VtVec3fArray &vertices,
                           const pxr::VtIntArray &indices, pxr::GfVec3f color, float radius);
 
+    /// Variant reading caller buffers directly: only the segment transforms are stored, so no copy of the vertices
+    /// is made, except in asynchronous mode where the buffers are copied before the call returns.
+    void render_line_list(const pxr::TfToken &name, std::span<const pxr::GfVec3f> vertices,
+                          std::span<const int> indices, pxr::GfVec3f color, float radius);
+
     void render_line_strip(const pxr::TfToken &name, const pxr::VtVec3fArray &vertices,
                            pxr::GfVec3f color, float radius);
 
+    void render_line_strip(const pxr::TfToken &name, std::span<const pxr::GfVec3f> vertices,
+                           pxr::GfVec3f color, float radius);
+
+    /// Point cloud at /root/<name> as UsdGeomPoints. Constant radius and color are authored as single-element
+    /// primvars with constant interpolation, so only the positions scale with the number of points.
     void render_point(const pxr::TfToken &name, const pxr::VtVec3fArray &points,
                       float radius, std::optional<pxr::GfVec3f> color = std::nullopt);
 
+    /// Per-point variant: widths (diameters) and colors hold one entry per point and use vertex interpolation.
+    /// Interpolation is not time-varying, a cloud should not switch between constant and per-point values.
+    void render_point(const pxr::TfToken &name, const pxr::VtVec3fArray &points, const pxr::VtFloatArray &widths,
+                      const std::optional<pxr::VtVec3fArray> &colors = std::nullopt);
+
+    /// Variant taking a caller buffer, wrapped without copy when owner is given, see make_vt_array.
+    void render_point(const pxr::TfToken &name, std::span<const pxr::GfVec3f> points,
+                      float radius, std::optional<pxr::GfVec3f> color = std::nullopt,
+                      std::shared_ptr<const void> owner = nullptr);
+
 private:
+    /// Attribute authored by the renderer. Once the attribute has a spec on the root layer, its path is kept so that
+    /// Sdf mode streams samples to the layer without going through UsdStage edit-target resolution.
+    struct _AttrSlot {
+        pxr::UsdAttribute attr;
+        pxr::SdfPath spec_path;
+        /// content hash and value of the last sample written by _write_if_changed or _write_sample
+        uint64_t hash{0};
+        pxr::VtValue last_value;
+        /// time of the latest sample skipped because it was unchanged
+        std::optional<pxr::UsdTimeCode> held_time;
+        /// time the value authored as the default by _write_topology was given at, until it changes
+        std::optional<pxr::UsdTimeCode> default_time;
+        /// last sample moved to a clip, re-authored at the start of the next chunk if that chunk writes none
+        pxr::VtValue chunk_tail;
+        /// primvar interpolation last authored by _set_interpolation
+        pxr::TfToken interpolation;
+        /// shard layer holding the values in sharded mode, -1 for the root layer
+        int shard{-1};
+        bool shard_spec{false};
+    };
+
+    /// Schema prim defined by the renderer, with the translate/orient/scale ops added on definition.
+    /// Entries are created once per path so steady-state frames only author values.
+    struct _PrimEntry {
+        pxr::UsdPrim prim;
+        _AttrSlot translate;
+        _AttrSlot orient;
+        _AttrSlot scale;
+        std::unordered_map<pxr::TfToken, _AttrSlot, pxr::TfToken::HashFunctor> attrs;
+        /// number of instances the protoIndices were authored for, point instancers only
+        size_t instance_count{0};
+        /// shard of the body the prim belongs to, -1 for the root layer
+        int shard{-1};
+        /// precision of the xform ops
+        Precision precision{Precision::Float};
+    };
+
+    /// Return the cached entry at path, defining the prim (and its xform ops if add_xform) on first use.
+    template<typename SchemaT>
+    _PrimEntry &_get_or_define(const pxr::SdfPath &path, bool add_xform, bool *created = nullptr);
+
+    /// Return the cached slot of the attribute name of entry.
+    static _AttrSlot &_attr(_PrimEntry &entry, const pxr::TfToken &name);
+
+    /// Set the primvar interpolation of the slot attribute when it differs from the last one set.
+    static void _set_interpolation(_AttrSlot &slot, const pxr::TfToken &interpolation);
+
+    /// Define the points prim at /root/<name> and write its positions.
+    _PrimEntry &_render_points(const pxr::TfToken &name, const pxr::VtVec3fArray &points);
+
+    /// Resolve the (prim, shape) paths of a shape, defining the instanceable blueprint scope for templates.
+    std::pair<pxr::SdfPath, pxr::SdfPath> _resolve_shape_paths(const pxr::TfToken &name, const pxr::TfToken &shape,
+                                                               const std::optional<pxr::TfToken> &parent_body,
+                                                               bool is_template);
+
+    /// Author the point instancer at /root/<name> with a single prototype.
+    pxr::SdfPath _render_instances(const pxr::TfToken &name, const pxr::SdfPath &prototype,
+                                   const pxr::VtVec3fArray &positions, const pxr::VtQuatfArray &orientations,
+                                   const std::optional<pxr::VtVec3fArray> &scales);
+
+    void _set_xform(_PrimEntry &entry, pxr::GfVec3f pos, pxr::GfQuatf rot, pxr::GfVec3f scale, float time);
+
+    /// Author value on the slot attribute, buffered when a frame is open.
+    void _write(_AttrSlot &slot, pxr::VtValue value, pxr::UsdTimeCode time = pxr::UsdTimeCode::Default());
+
+    /// Write value unless its content hash matches the last sample of the slot. Returns true when written.
+    /// When a change follows skipped samples, the previous value is first re-authored at the last skipped time so
+    /// that interpolation still holds it over the skipped range.
+    bool _write_if_changed(_AttrSlot &slot, pxr::VtValue value, uint64_t hash, pxr::UsdTimeCode time);
+
+    /// Author the first value as the default, a topology that never changes has no samples. When it changes, the
+    /// first value becomes a sample at the time it was given and the later ones follow _write_if_changed.
+    bool _write_topology(_AttrSlot &slot, pxr::VtValue value, uint64_t hash);
+
+    /// Write value unless it is within the change epsilon of the last sample of the slot, with the same hold rule.
+    bool _write_sample(_AttrSlot &slot, pxr::VtValue value, pxr::UsdTimeCode time);
+
+    bool _hold_or_write(_AttrSlot &slot, bool changed, pxr::VtValue value, pxr::UsdTimeCode time);
+
+    /// Move the sample of a change-tracked attribute with a single sample to its default value.
+    void _collapse(_AttrSlot &slot);
+
+    /// Shard of the registered body path belongs to, -1 when it is not under a sharded body.
+    int _shard_of(const pxr::SdfPath &path) const;
+
+    /// Layer holding the values of the slot.
+    pxr::SdfLayerHandle _layer_of(const _AttrSlot &slot) const;
+
+    /// Copy the shard opinions into the root layer, or export the shards and add them as sublayers.
+    void _output_shards();
+
+    void _for_each_slot(const std::function<void(_AttrSlot &)> &fn);
+
+    /// Move the samples written since the last chunk to a new clip layer and update the clip metadata of /root.
+    void _flush_chunk();
+
+    /// Author value now, through Usd until the slot has a spec, then on the root layer in Sdf mode.
+    void _author(_AttrSlot &slot, const pxr::VtValue &value, pxr::UsdTimeCode time);
+
+    void _flush_writes();
+
+    struct _PendingWrite {
+        _AttrSlot *slot;
+        pxr::VtValue value;
+        pxr::UsdTimeCode time;
+    };
+
+    /// Render calls captured for the writer thread, with the time of the frame they belong to.
+    struct _CapturedFrame {
+        std::optional<float> time;
+        std::vector<std::function<void()>> calls;
+    };
+
+    /// Capture call for the writer thread instead of running it. Returns false when the call must run now.
+    bool _defer(std::function<void()> call);
+
+    /// True on the calling thread in asynchronous mode, where render calls are deferred to the writer thread.
+    bool _is_deferring() const;
+
+    void _submit(_CapturedFrame frame);
+
+    void _writer_loop();
+
     pxr::UsdStageRefPtr _stage;
+    pxr::SdfLayerHandle _layer;
     pxr::UsdGeomXform _root;
+    std::unordered_map<pxr::SdfPath, _PrimEntry, pxr::SdfPath::Hash> _prims;
 
     float _fps;
     UpAxis _up_axis;
     float _time{0};
+
+    FlushMode _flush_mode{FlushMode::Usd};
+    std::atomic<size_t> _values_written{0};
+    std::atomic<size_t> _bytes_written{0};
+
+    Precision _precision{Precision::Float};
+    PrecisionReport _precision_report;
+    float _change_epsilon{1e-6f};
+    bool _skip_unchanged_points{false};
+    bool _in_frame{false};
+    std::vector<_PendingWrite> _pending_writes;
+
+    std::vector<pxr::SdfLayerRefPtr> _shards;
+    std::vector<std::vector<_PendingWrite>> _shard_writes;
+    std::unordered_map<pxr::SdfPath, int, pxr::SdfPath::Hash> _body_shards;
+    ShardOutput _shard_output{ShardOutput::Merge};
+
+    size_t _chunk_frames{0};
+    size_t _chunk_frame_count{0};
+    std::optional<double> _chunk_start;
+    std::string _clip_prefix;
+    pxr::SdfLayerRefPtr _clip_manifest;
+    pxr::VtArray<pxr::SdfAssetPath> _clip_assets;
+    pxr::VtVec2dArray _clip_active;
+    pxr::VtVec2dArray _clip_times;
+
+    bool _async{false};
+    size_t _max_queued_frames{2};
+    _CapturedFrame _capture;
+    std::deque<_CapturedFrame> _frame_queue;
+    bool _writer_busy{false};
+    bool _writer_stop{false};
+    std::mutex _queue_mutex;
+    std::condition_variable _queue_cv;
+    std::thread _writer;
 };
 
 }// namespace vox
\ No newline at end of file
@@ -0,0 +1,132 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#include "usd_segment_xform.h"
+
+#include <pxr/base/work/loops.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace vox {
+namespace {
+// segments are processed in blocks gathered into a structure-of-arrays scratch, so that the arithmetic loops
+// below have no gathers or branches and can be vectorized by the compiler
+constexpr size_t kBlockSize = 256;
+// below this many segments the parallel dispatch costs more than it saves
+constexpr size_t kParallelThreshold = 16384;
+
+struct SegmentBlock {
+    float x0[kBlockSize], y0[kBlockSize], z0[kBlockSize];
+    float x1[kBlockSize], y1[kBlockSize], z1[kBlockSize];
+    // outputs: midpoint, length and rotation (qw, qx, qy; qz is always 0 for a rotation from the z axis)
+    float mx[kBlockSize], my[kBlockSize], mz[kBlockSize];
+    float len[kBlockSize];
+    float qw[kBlockSize], qx[kBlockSize], qy[kBlockSize];
+};
+
+void _compute_block(SegmentBlock &b, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        b.mx[i] = (b.x0[i] + b.x1[i]) * 0.5f;
+        b.my[i] = (b.y0[i] + b.y1[i]) * 0.5f;
+        b.mz[i] = (b.z0[i] + b.z1[i]) * 0.5f;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const float dx = b.x1[i] - b.x0[i];
+        const float dy = b.y1[i] - b.y0[i];
+        const float dz = b.z1[i] - b.z0[i];
+        const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        // degenerate segments get a zero direction, which yields the identity rotation below
+        const float inv_length = length > 0.f ? 1.f / length : 0.f;
+
+        // shortest rotation from (0, 0, 1) to the direction n: normalize(1 + n.z, cross(z, n))
+        const float nx = dx * inv_length;
+        const float ny = dy * inv_length;
+        const float nz = dz * inv_length;
+        float w = 1.f + nz;
+        float x = -ny;
+        float y = nx;
+        const float norm = std::sqrt(w * w + x * x + y * y);
+        // anti-parallel directions have no unique shortest rotation, turn half way around x
+        const bool flipped = norm < 1e-6f;
+        const float inv_norm = flipped ? 0.f : 1.f / norm;
+        w = w * inv_norm;
+        x = flipped ? 1.f : x * inv_norm;
+        y = y * inv_norm;
+
+        b.len[i] = length;
+        b.qw[i] = w;
+        b.qx[i] = x;
+        b.qy[i] = y;
+    }
+}
+
+template<typename EndpointsFn>
+void _compute_segments(size_t num_segments, EndpointsFn &&endpoints, SegmentXforms &out) {
+    out.positions.resize(num_segments);
+    out.orientations.resize(num_segments);
+    out.scales.resize(num_segments);
+
+    auto *positions = out.positions.data();
+    auto *orientations = out.orientations.data();
+    auto *scales = out.scales.data();
+
+    const size_t num_blocks = (num_segments + kBlockSize - 1) / kBlockSize;
+    auto process = [&](size_t block_begin, size_t block_end) {
+        SegmentBlock block;
+        for (size_t block_index = block_begin; block_index < block_end; ++block_index) {
+            const size_t first = block_index * kBlockSize;
+            const size_t count = std::min(kBlockSize, num_segments - first);
+
+            for (size_t i = 0; i < count; ++i) {
+                const auto [p0, p1] = endpoints(first + i);
+                block.x0[i] = p0[0];
+                block.y0[i] = p0[1];
+                block.z0[i] = p0[2];
+                block.x1[i] = p1[0];
+                block.y1[i] = p1[1];
+                block.z1[i] = p1[2];
+            }
+
+            _compute_block(block, count);
+
+            for (size_t i = 0; i < count; ++i) {
+                positions[first + i] = pxr::GfVec3f(block.mx[i], block.my[i], block.mz[i]);
+                orientations[first + i] = pxr::GfQuath(block.qw[i], block.qx[i], block.qy[i], 0.f);
+                scales[first + i] = pxr::GfVec3f(1.f, 1.f, block.len[i]);
+            }
+        }
+    };
+
+    if (num_segments >= kParallelThreshold) {
+        pxr::WorkParallelForN(num_blocks, process, 1);
+    } else {
+        process(0, num_blocks);
+    }
+}
+}// namespace
+
+void compute_segment_xforms(std::span<const pxr::GfVec3f> vertices, std::span<const int> indices, SegmentXforms &out) {
+    _compute_segments(
+        indices.size() / 2,
+        [&](size_t i) {
+            return std::pair<const pxr::GfVec3f &, const pxr::GfVec3f &>(vertices[indices[i * 2 + 0]],
+                                                                         vertices[indices[i * 2 + 1]]);
+        },
+        out);
+}
+
+void compute_segment_xforms(std::span<const pxr::GfVec3f> vertices, SegmentXforms &out) {
+    _compute_segments(
+        vertices.empty() ? 0 : vertices.size() - 1,
+        [&](size_t i) {
+            return std::pair<const pxr::GfVec3f &, const pxr::GfVec3f &>(vertices[i], vertices[i + 1]);
+        },
+        out);
+}
+
+}// namespace vox
@@ -0,0 +1,29 @@
+//  Copyright (c) 2023 Feng Yang
+//
+//  I am making my contributions/submissions to this project solely in my
+//  personal capacity and am not conveying any rights to any intellectual
+//  property of any third parties.
+
+#pragma once
+
+#include <pxr/base/vt/types.h>
+
+#include <span>
+
+namespace vox {
+/// Transforms of the capsules connecting pairs of points: a unit capsule along z is moved to the midpoint,
+/// rotated onto the segment direction and scaled along z by the segment length.
+struct SegmentXforms {
+    pxr::VtVec3fArray positions;
+    pxr::VtQuathArray orientations;
+    pxr::VtVec3fArray scales;
+};
+
+/// Compute the transforms of the segments (vertices[indices[2 * i]], vertices[indices[2 * i + 1]]).
+/// The output arrays are resized once and filled in place; large inputs are processed in parallel.
+void compute_segment_xforms(std::span<const pxr::GfVec3f> vertices, std::span<const int> indices, SegmentXforms &out);
+
+/// Compute the transforms of the segments (vertices[i], vertices[i + 1]) of a line strip.
+void compute_segment_xforms(std::span<const pxr::GfVec3f> vertices, SegmentXforms &out);
+
+}// namespace vox